@@ -0,0 +1,76 @@
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_ALIGNMENT 8
+#define ARENA_ALIGN(x) (((x) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+void initialize_arena(arena* memory, size_t block_size)
+{
+    memory->blocks = NULL;
+    memory->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK_SIZE;
+}
+
+void* allocate_from_arena(arena* memory, size_t size)
+{
+    arena_block* block = memory->blocks;
+    size_t header = ARENA_ALIGN(sizeof(arena_block));
+
+    size = ARENA_ALIGN(size);
+
+    if (!block || block->size - block->used < size)
+    {
+        size_t block_size = memory->block_size;
+
+        if (block_size < header + size)
+            block_size = header + size;
+
+        block = (arena_block*)malloc(block_size);
+
+        if (!block)
+            return NULL;
+
+        block->used = header;
+        block->size = block_size;
+
+        // Keep the block with more free space at the head of the list, so an
+        // oversized request doesn't waste what's left of the current block.
+        if (memory->blocks && block->size - block->used - size < memory->blocks->size - memory->blocks->used)
+        {
+            block->next = memory->blocks->next;
+            memory->blocks->next = block;
+        }
+        else
+        {
+            block->next = memory->blocks;
+            memory->blocks = block;
+        }
+    }
+
+    void* ptr = (uint8_t*)block + block->used;
+    block->used += size;
+
+    return ptr;
+}
+
+void* allocate_zeroed_from_arena(arena* memory, size_t size)
+{
+    void* ptr = allocate_from_arena(memory, size);
+
+    if (ptr)
+        memset(ptr, 0, size);
+
+    return ptr;
+}
+
+void release_arena(arena* memory)
+{
+    arena_block* block;
+
+    while (memory->blocks)
+    {
+        block = memory->blocks;
+        memory->blocks = block->next;
+        free(block);
+    }
+}
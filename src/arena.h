@@ -0,0 +1,27 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARENA_DEFAULT_BLOCK_SIZE 4096
+
+typedef struct arena_block
+{
+    struct arena_block* next;
+    size_t used;
+    size_t size;
+} arena_block;
+
+typedef struct arena
+{
+    arena_block* blocks;
+    size_t block_size;
+} arena;
+
+void initialize_arena(arena*, size_t);
+void* allocate_from_arena(arena*, size_t);
+void* allocate_zeroed_from_arena(arena*, size_t);
+void release_arena(arena*);
+
+#endif
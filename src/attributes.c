@@ -5,11 +5,11 @@
 #include "opcodes.h"
 #include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define DECLARE_ATTRIBUTE_FUNCTIONS(attribute) \
     uint8_t read_attribute_##attribute(java_class* jc, attribute_info* entry); \
-    void print_attribute_##attribute(java_class* jc, attribute_info* entry, int ident_level); \
-    void free_attribute_##attribute(attribute_info* entry);
+    void print_attribute_##attribute(java_class* jc, attribute_info* entry, int ident_level);
 
 DECLARE_ATTRIBUTE_FUNCTIONS(SourceFile)
 DECLARE_ATTRIBUTE_FUNCTIONS(InnerClasses)
@@ -46,7 +46,7 @@ char attribute_read(java_class* jc, attribute_info* entry)
             result = read_attribute_##name(jc, entry); \
         }
 
-    uint32_t total_bytes_read = jc->total_bytes_read;
+    uint32_t total_bytes_read = jc->reader->total_bytes_read;
     char result;
 
     IF_ATTRIBUTE_CHECK(ConstantValue)
@@ -58,24 +58,17 @@ char attribute_read(java_class* jc, attribute_info* entry)
     else IF_ATTRIBUTE_CHECK(Exceptions)
     else
     {
-        uint32_t u32;
-
-        for (u32 = 0; u32 < entry->length; u32++)
+        if (!read_byte_span(jc, entry->length, NULL))
         {
-            if (fgetc(jc->file) == EOF)
-            {
-                jc->status = UNXPTD_EOF_READING_ATTR_INFO;
-                return 0;
-            }
-
-            jc->total_bytes_read++;
+            jc->status = UNXPTD_EOF_READING_ATTR_INFO;
+            return 0;
         }
 
         result = 1;
         entry->attr_type = ATTRIBUTE_Unknown;
     }
 
-    if (jc->total_bytes_read - total_bytes_read != entry->length)
+    if (result && jc->reader->total_bytes_read - total_bytes_read != entry->length)
     {
         jc->status = ATTR_LEN_MISMATCH;
         return 0;
@@ -103,14 +96,9 @@ void print_attribute_Deprecated(java_class* jc, attribute_info* entry, int ident
     printf("This element is marked as deprecated and should no longer be used.");
 }
 
-void free_attribute_Deprecated(attribute_info* entry)
-{
-
-}
-
 uint8_t read_attribute_ConstantValue(java_class* jc, attribute_info* entry)
 {
-    atrt_const_value_info* info = (atrt_const_value_info*)malloc(sizeof(atrt_const_value_info));
+    atrt_const_value_info* info = (atrt_const_value_info*)allocate_from_arena(&jc->memory, sizeof(atrt_const_value_info));
     entry->info = (void*)info;
 
     if (!info)
@@ -187,17 +175,9 @@ void print_attribute_ConstantValue(java_class* jc, attribute_info* entry, int id
     printf(">");
 }
 
-void free_attribute_ConstantValue(attribute_info* entry)
-{
-    if (entry->info)
-        free(entry->info);
-
-    entry->info = NULL;
-}
-
 uint8_t read_attribute_SourceFile(java_class* jc, attribute_info* entry)
 {
-    attr_sourcefile_info* info = (attr_sourcefile_info*)malloc(sizeof(attr_sourcefile_info));
+    attr_sourcefile_info* info = (attr_sourcefile_info*)allocate_from_arena(&jc->memory, sizeof(attr_sourcefile_info));
     entry->info = (void*)info;
 
     if (!info)
@@ -235,17 +215,9 @@ void print_attribute_SourceFile(java_class* jc, attribute_info* entry, int ident
     printf("sourcefile_index: #%u <%s>", info->sourcefile_index, buffer);
 }
 
-void free_attribute_SourceFile(attribute_info* entry)
-{
-    if (entry->info)
-        free(entry->info);
-
-    entry->info = NULL;
-}
-
 uint8_t read_attribute_InnerClasses(java_class* jc, attribute_info* entry)
 {
-    attr_inner_classes_info* info = (attr_inner_classes_info*)malloc(sizeof(attr_inner_classes_info));
+    attr_inner_classes_info* info = (attr_inner_classes_info*)allocate_from_arena(&jc->memory, sizeof(attr_inner_classes_info));
     entry->info = (void*)info;
 
     if (!info)
@@ -262,7 +234,7 @@ uint8_t read_attribute_InnerClasses(java_class* jc, attribute_info* entry)
         return 0;
     }
 
-    info->inner_classes = (inner_class_info*)malloc(info->number_of_classes * sizeof(inner_class_info));
+    info->inner_classes = (inner_class_info*)allocate_from_arena(&jc->memory, info->number_of_classes * sizeof(inner_class_info));
 
     if (!info->inner_classes)
     {
@@ -358,24 +330,9 @@ void print_attribute_InnerClasses(java_class* jc, attribute_info* entry, int ide
     }
 }
 
-void free_attribute_InnerClasses(attribute_info* entry)
-{
-    attr_inner_classes_info* info = (attr_inner_classes_info*)entry->info;
-
-    if (info)
-    {
-        if (info->inner_classes)
-            free(info->inner_classes);
-
-        free(info);
-    }
-
-    entry->info = NULL;
-}
-
 uint8_t read_attribute_LineNumberTable(java_class* jc, attribute_info* entry)
 {
-    attr_line_number_table_info* info = (attr_line_number_table_info*)malloc(sizeof(attr_line_number_table_info));
+    attr_line_number_table_info* info = (attr_line_number_table_info*)allocate_from_arena(&jc->memory, sizeof(attr_line_number_table_info));
     entry->info = (void*)info;
 
     if (!info)
@@ -392,7 +349,7 @@ uint8_t read_attribute_LineNumberTable(java_class* jc, attribute_info* entry)
         return 0;
     }
 
-    info->line_number_table = (line_number_table_entry*)malloc(info->line_number_table_length * sizeof(line_number_table_entry));
+    info->line_number_table = (line_number_table_entry*)allocate_from_arena(&jc->memory, info->line_number_table_length * sizeof(line_number_table_entry));
 
     if (!info->line_number_table)
     {
@@ -436,32 +393,109 @@ void print_attribute_LineNumberTable(java_class* jc, attribute_info* entry, int
     }
 }
 
-void free_attribute_LineNumberTable(attribute_info* entry)
+static uint8_t lazy_code_attributes = 0;
+
+void set_lazy_code_attributes(uint8_t lazy)
 {
-    attr_line_number_table_info* info = (attr_line_number_table_info*)entry->info;
+    lazy_code_attributes = lazy;
+}
+
+static uint32_t read_code_u32(const uint8_t* code)
+{
+    return ((uint32_t)code[0] << 24) | ((uint32_t)code[1] << 16) | ((uint32_t)code[2] << 8) | code[3];
+}
+
+// The quick opcodes are only ever written by the interpreter, which trusts
+// the operands they carry, so they must not come from a class file. Walking
+// the instructions keeps operand bytes from being mistaken for opcodes.
+static uint8_t check_code_instructions(java_class* jc, const uint8_t* code, uint32_t code_length)
+{
+    uint32_t offset = 0;
+    uint64_t length;
+    int64_t low, high;
+    uint8_t opcode;
 
-    if (info)
+    while (offset < code_length)
     {
-        if (info->line_number_table)
-            free(info->line_number_table);
+        opcode = code[offset];
+
+        if (opcode >= opcode_getstatic_quick && opcode <= opcode_new_quick)
+        {
+            jc->status = ATTR_RSVD_OPCODE;
+            return 0;
+        }
+
+        switch (opcode)
+        {
+            case opcode_bipush: case opcode_ldc: case opcode_newarray: case opcode_ret:
+            case opcode_iload: case opcode_lload: case opcode_fload: case opcode_dload: case opcode_aload:
+            case opcode_istore: case opcode_lstore: case opcode_fstore: case opcode_dstore: case opcode_astore:
+                length = 2;
+                break;
+
+            case opcode_sipush: case opcode_ldc_w: case opcode_ldc2_w: case opcode_iinc:
+            case opcode_getstatic: case opcode_putstatic: case opcode_getfield: case opcode_putfield:
+            case opcode_invokevirtual: case opcode_invokespecial: case opcode_invokestatic:
+            case opcode_new: case opcode_anewarray: case opcode_checkcast: case opcode_instanceof:
+            case opcode_ifnull: case opcode_ifnonnull:
+                length = 3;
+                break;
+
+            case opcode_multianewarray:
+                length = 4;
+                break;
 
-        free(info);
-        entry->info = NULL;
+            case opcode_invokeinterface: case opcode_invokedynamic: case opcode_goto_w: case opcode_jsr_w:
+                length = 5;
+                break;
+
+            case opcode_wide:
+                length = offset + 1 < code_length && code[offset + 1] == opcode_iinc ? 6 : 4;
+                break;
+
+            case opcode_tableswitch:
+            case opcode_lookupswitch:
+                // Operands start on the next 4-byte boundary.
+                length = 4 - (offset & 3);
+
+                if (length + 12 > code_length - offset)
+                {
+                    jc->status = ATTR_INV_CODE_LEN;
+                    return 0;
+                }
+
+                low = (int32_t)read_code_u32(code + offset + length + 4);
+                high = (int32_t)read_code_u32(code + offset + length + 8);
+
+                if (opcode == opcode_lookupswitch)
+                    length += 8 + (uint64_t)(uint32_t)low * 8;
+                else if (high >= low)
+                    length += 12 + (uint64_t)(high - low + 1) * 4;
+                else
+                    length = UINT64_MAX;
+                break;
+
+            default:
+                length = opcode >= opcode_ifeq && opcode <= opcode_jsr ? 3 : 1;
+                break;
+        }
+
+        if (length > code_length - offset)
+        {
+            jc->status = ATTR_INV_CODE_LEN;
+            return 0;
+        }
+
+        offset += (uint32_t)length;
     }
+
+    return 1;
 }
 
-uint8_t read_attribute_Code(java_class* jc, attribute_info* entry)
+static uint8_t read_code_body(java_class* jc, attr_code_info* info, uint8_t copy_code)
 {
-    attr_code_info* info = (attr_code_info*)malloc(sizeof(attr_code_info));
-    entry->info = (void*)info;
     uint32_t u32;
 
-    if (!info)
-    {
-        jc->status = MEM_ALLOC_FAILED;
-        return 0;
-    }
-
     info->code = NULL;
     info->exception_table = NULL;
 
@@ -479,23 +513,34 @@ uint8_t read_attribute_Code(java_class* jc, attribute_info* entry)
         return 0;
     }
 
-    info->code = (uint8_t*)malloc(info->code_length);
+    const uint8_t* code;
 
-    if (!info->code)
+    if (!read_byte_span(jc, info->code_length, &code))
     {
-        jc->status = MEM_ALLOC_FAILED;
+        jc->status = UNXPTD_EOF_READING_ATTR_INFO;
         return 0;
     }
 
-    if (fread(info->code, sizeof(uint8_t), info->code_length, jc->file) != info->code_length)
+    if (copy_code)
     {
-        jc->status = UNXPTD_EOF_READING_ATTR_INFO;
-        return 0;
-    }
+        info->code = (uint8_t*)allocate_from_arena(&jc->memory, info->code_length);
 
-    jc->total_bytes_read += info->code_length;
+        if (!info->code)
+        {
+            jc->status = MEM_ALLOC_FAILED;
+            return 0;
+        }
+
+        memcpy(info->code, code, info->code_length);
+    }
+    else
+    {
+        info->code = (uint8_t*)code;
+    }
 
     // TODO: check if all instructions are valid and have correct parameters.
+    if (!check_code_instructions(jc, info->code, info->code_length))
+        return 0;
 
     if (!read_2_byte_unsigned(jc, &info->exception_table_length))
     {
@@ -503,7 +548,7 @@ uint8_t read_attribute_Code(java_class* jc, attribute_info* entry)
         return 0;
     }
 
-    info->exception_table = (exception_table_entry*)malloc(info->exception_table_length * sizeof(exception_table_entry));
+    info->exception_table = (exception_table_entry*)allocate_from_arena(&jc->memory, info->exception_table_length * sizeof(exception_table_entry));
 
     if (!info->exception_table)
     {
@@ -533,7 +578,7 @@ uint8_t read_attribute_Code(java_class* jc, attribute_info* entry)
         return 0;
     }
 
-    info->attributes = (attribute_info*)malloc(info->attributes_count * sizeof(attribute_info));
+    info->attributes = (attribute_info*)allocate_from_arena(&jc->memory, info->attributes_count * sizeof(attribute_info));
 
     if (!info->attributes)
     {
@@ -553,11 +598,145 @@ uint8_t read_attribute_Code(java_class* jc, attribute_info* entry)
     return 1;
 }
 
+uint8_t read_attribute_Code(java_class* jc, attribute_info* entry)
+{
+    attr_code_info* info = (attr_code_info*)allocate_from_arena(&jc->memory, sizeof(attr_code_info));
+    entry->info = (void*)info;
+
+    if (!info)
+    {
+        jc->status = MEM_ALLOC_FAILED;
+        return 0;
+    }
+
+    info->encoded_offset = info->encoded_length = 0;
+
+    if (!lazy_code_attributes)
+        return read_code_body(jc, info, 1);
+
+    // Only the position of the attribute is kept; decode_code_attribute
+    // parses it the first time the method is about to run. A borrowed image
+    // outlives the class, any other image has its undecoded attributes moved
+    // out by detach_code_attributes before it is released.
+    const uint8_t* encoded;
+
+    if (entry->length < 4 || !read_byte_span(jc, entry->length, &encoded))
+    {
+        jc->status = UNXPTD_EOF_READING_ATTR_INFO;
+        return 0;
+    }
+
+    // max_stack and max_locals lead the attribute and are needed before the
+    // body is decoded.
+    info->max_stack = (uint16_t)((encoded[0] << 8) | encoded[1]);
+    info->max_locals = (uint16_t)((encoded[2] << 8) | encoded[3]);
+    info->encoded_offset = (uint32_t)(encoded - jc->image);
+    info->encoded_length = entry->length;
+    jc->code_image = jc->image;
+
+    info->code = NULL;
+    info->code_length = 0;
+    info->exception_table_length = info->attributes_count = 0;
+    info->exception_table = NULL;
+    info->attributes = NULL;
+
+    return 1;
+}
+
+uint8_t decode_code_attribute(java_class* jc, attr_code_info* info)
+{
+    if (!info->encoded_length)
+        return 1;
+
+    const uint8_t* image = jc->image;
+    uint32_t image_length = jc->image_length;
+    class_reader* reader = jc->reader;
+    class_reader code_reader = { 0 };
+    uint8_t success;
+
+    jc->image = jc->code_image + info->encoded_offset;
+    jc->image_length = info->encoded_length;
+    jc->reader = &code_reader;
+
+    // The interpreter rewrites instructions, so code is copied out of a class
+    // image. Code moved into the arena can be used in place.
+    success = read_code_body(jc, info, jc->code_image == image);
+
+    if (success && code_reader.total_bytes_read != info->encoded_length)
+    {
+        jc->status = ATTR_LEN_MISMATCH;
+        success = 0;
+    }
+
+    jc->image = image;
+    jc->image_length = image_length;
+    jc->reader = reader;
+
+    if (success)
+        info->encoded_offset = info->encoded_length = 0;
+
+    return success;
+}
+
+// Copies the Code attributes not decoded yet into a single arena block, so
+// the class image can be released.
+uint8_t detach_code_attributes(java_class* jc)
+{
+    attr_code_info* info;
+    uint32_t total = 0;
+    uint8_t* buffer;
+    uint16_t u16;
+
+    if (!jc->code_image)
+        return 1;
+
+    for (u16 = 0; u16 < jc->method_count; u16++)
+    {
+        if (jc->methods[u16].code)
+            total += jc->methods[u16].code->encoded_length;
+    }
+
+    if (total == 0)
+    {
+        jc->code_image = NULL;
+        return 1;
+    }
+
+    buffer = (uint8_t*)allocate_from_arena(&jc->memory, total);
+
+    if (!buffer)
+        return 0;
+
+    total = 0;
+
+    for (u16 = 0; u16 < jc->method_count; u16++)
+    {
+        info = jc->methods[u16].code;
+
+        if (!info || !info->encoded_length)
+            continue;
+
+        memcpy(buffer + total, jc->code_image + info->encoded_offset, info->encoded_length);
+        info->encoded_offset = total;
+        total += info->encoded_length;
+    }
+
+    jc->code_image = buffer;
+    return 1;
+}
+
 void print_attribute_Code(java_class* jc, attribute_info* entry, int ident_level)
 {
     attr_code_info* info = (attr_code_info*)entry->info;
     uint32_t code_offset;
 
+    if (!decode_code_attribute(jc, info))
+    {
+        ident(ident_level);
+        printf("- Code attribute could not be decoded: %s -", decode_java_class_status(jc->status));
+        return;
+    }
+
     printf("\n");
     ident(ident_level);
     printf("max_stack: %u, max_locals: %u, code_length: %u\n", info->max_stack, info->max_locals, info->code_length);
@@ -1084,36 +1263,9 @@ void print_attribute_Code(java_class* jc, attribute_info* entry, int ident_level
     }
 }
 
-void free_attribute_Code(attribute_info* entry)
-{
-    attr_code_info* info = (attr_code_info*)entry->info;
-
-    if (info)
-    {
-        if (info->code)
-            free(info->code);
-
-        if (info->exception_table)
-            free(info->exception_table);
-
-        if (info->attributes)
-        {
-            uint16_t u16;
-
-            for (u16 = 0; u16 < info->attributes_count; u16++)
-                free_attribute_info(info->attributes + u16);
-
-            free(info->attributes);
-        }
-
-        free(info);
-        entry->info = NULL;
-    }
-}
-
 uint8_t read_attribute_Exceptions(java_class* jc, attribute_info* entry)
 {
-    attr_exceptions_info* info = (attr_exceptions_info*)malloc(sizeof(attr_exceptions_info));
+    attr_exceptions_info* info = (attr_exceptions_info*)allocate_from_arena(&jc->memory, sizeof(attr_exceptions_info));
     entry->info = (void*)info;
 
     if (!info)
@@ -1130,7 +1282,7 @@ uint8_t read_attribute_Exceptions(java_class* jc, attribute_info* entry)
         return 0;
     }
 
-    info->exception_index_table = (uint16_t*)malloc(info->number_of_exceptions * sizeof(uint16_t));
+    info->exception_index_table = (uint16_t*)allocate_from_arena(&jc->memory, info->number_of_exceptions * sizeof(uint16_t));
 
     if (!info->exception_index_table)
     {
@@ -1185,40 +1337,6 @@ void print_attribute_Exceptions(java_class* jc, attribute_info* entry, int ident
     }
 }
 
-void free_attribute_Exceptions(attribute_info* entry)
-{
-    attr_exceptions_info* info = (attr_exceptions_info*)entry->info;
-
-    if (info)
-    {
-        if (info->exception_index_table)
-            free(info->exception_index_table);
-
-        free(info);
-        entry->info = NULL;
-    }
-}
-
-void free_attribute_info(attribute_info* entry)
-{
-    #define ATTRIBUTE_CASE(attribute) case ATTRIBUTE_##attribute: free_attribute_##attribute(entry); return;
-
-    switch (entry->attr_type)
-    {
-        ATTRIBUTE_CASE(Code)
-        ATTRIBUTE_CASE(LineNumberTable)
-        ATTRIBUTE_CASE(SourceFile)
-        ATTRIBUTE_CASE(InnerClasses)
-        ATTRIBUTE_CASE(ConstantValue)
-        ATTRIBUTE_CASE(Deprecated)
-        ATTRIBUTE_CASE(Exceptions)
-        default:
-            break;
-    }
-
-    #undef ATTRIBUTE_CASE
-}
-
 void attribute_print(java_class* jc, attribute_info* entry, int ident_level)
 {
     #define ATTRIBUTE_CASE(attribute) case ATTRIBUTE_##attribute: print_attribute_##attribute(jc, entry, ident_level); break;
@@ -2,6 +2,7 @@
 #define ATTRIBUTES_H
 
 typedef struct attribute_info attribute_info;
+typedef struct attr_code_info attr_code_info;
 
 #include <stdint.h>
 #include "javaclass.h"
@@ -61,7 +62,7 @@ typedef struct {
     uint16_t catch_type;
 } exception_table_entry;
 
-typedef struct {
+struct attr_code_info {
     uint16_t max_stack;
     uint16_t max_locals;
     uint32_t code_length;
@@ -70,7 +71,9 @@ typedef struct {
     exception_table_entry* exception_table;
     uint16_t attributes_count;
     attribute_info* attributes;
-} attr_code_info;
+    uint32_t encoded_offset;
+    uint32_t encoded_length;
+};
 
 typedef struct {
     uint16_t number_of_exceptions;
@@ -78,7 +81,9 @@ typedef struct {
 } attr_exceptions_info;
 
 char attribute_read(java_class *, attribute_info *);
-void free_attribute_info(attribute_info *);
+void set_lazy_code_attributes(uint8_t);
+uint8_t decode_code_attribute(java_class *, attr_code_info *);
+uint8_t detach_code_attributes(java_class *);
 void attribute_print(java_class *, attribute_info *, int);
 void attributes_print_all(java_class *);
 attribute_info* get_attribute_using_type(attribute_info *, uint16_t,
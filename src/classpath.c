@@ -0,0 +1,225 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "classpath.h"
+#include "utf8.h"
+#ifndef _WIN32
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#define CLASS_PATH_NAME_BLOCK_SIZE 16384
+#define CLASS_PATH_MAX_DEPTH 64
+
+static uint8_t has_suffix(const char* path, int32_t length, const char* suffix)
+{
+    int32_t suffix_length = strlen(suffix);
+
+    return length >= suffix_length && memcmp(path + length - suffix_length, suffix, suffix_length) == 0;
+}
+
+#ifndef _WIN32
+static uint8_t add_class_path_name(class_path_entry* entry, class_path_name** names, const char* name, uint16_t length)
+{
+    class_path_name* node = (class_path_name*)allocate_from_arena(&entry->memory, sizeof(class_path_name) + length + 1);
+
+    if (!node)
+        return 0;
+
+    node->name = (char*)(node + 1);
+    memcpy(node->name, name, length);
+    node->name[length] = '\0';
+    node->length = length;
+    node->hash = utf8_hash((const uint8_t*)name, length);
+    node->next = *names;
+    *names = node;
+
+    return 1;
+}
+
+static uint8_t scan_directory(class_path_entry* entry, class_path_name** names, uint32_t* count,
+                              char* relative, int32_t relative_length, int32_t depth)
+{
+    char path[1024];
+    struct stat file_info;
+    struct dirent* item;
+    DIR* dir;
+    int32_t length;
+    uint8_t success = 1;
+
+    snprintf(path, sizeof(path), "%s%s", entry->directory, relative);
+    dir = opendir(path);
+
+    if (!dir)
+        return 1;
+
+    while (success && (item = readdir(dir)))
+    {
+        if (!strcmp(item->d_name, ".") || !strcmp(item->d_name, ".."))
+            continue;
+
+        length = strlen(item->d_name);
+
+        if (relative_length + length + 2 > 1024)
+            continue;
+
+        memcpy(relative + relative_length, item->d_name, length + 1);
+        snprintf(path, sizeof(path), "%s%s", entry->directory, relative);
+
+        if (lstat(path, &file_info) != 0)
+            continue;
+
+        if (S_ISDIR(file_info.st_mode))
+        {
+            if (depth < CLASS_PATH_MAX_DEPTH)
+            {
+                relative[relative_length + length] = '/';
+                relative[relative_length + length + 1] = '\0';
+                success = scan_directory(entry, names, count, relative, relative_length + length + 1, depth + 1);
+            }
+        }
+        else if (has_suffix(item->d_name, length, ".class") &&
+                 (S_ISREG(file_info.st_mode) || (S_ISLNK(file_info.st_mode) && stat(path, &file_info) == 0 && S_ISREG(file_info.st_mode))))
+        {
+            success = add_class_path_name(entry, names, relative, relative_length + length);
+            (*count)++;
+        }
+    }
+
+    relative[relative_length] = '\0';
+    closedir(dir);
+
+    return success;
+}
+#endif
+
+static uint8_t index_directory(class_path_entry* entry)
+{
+#ifndef _WIN32
+    class_path_name* names = NULL;
+    class_path_name* node;
+    class_path_name* next;
+    char relative[1024];
+    uint32_t count = 0;
+    uint32_t table_size = 1;
+
+    relative[0] = '\0';
+
+    if (!scan_directory(entry, &names, &count, relative, 0, 0))
+        return 0;
+
+    while (table_size < count * 2)
+        table_size <<= 1;
+
+    entry->name_table = (class_path_name**)allocate_zeroed_from_arena(&entry->memory, table_size * sizeof(class_path_name*));
+    entry->name_table_mask = table_size - 1;
+
+    if (!entry->name_table)
+        return 0;
+
+    for (node = names; node; node = next)
+    {
+        next = node->next;
+        node->next = entry->name_table[node->hash & entry->name_table_mask];
+        entry->name_table[node->hash & entry->name_table_mask] = node;
+    }
+#endif
+
+    return 1;
+}
+
+class_path_entry* open_class_path_entry(const char* path, int32_t length)
+{
+    class_path_entry* entry = (class_path_entry*)malloc(sizeof(class_path_entry));
+    char buffer[1024];
+
+    if (!entry || length <= 0 || length + 2 > (int32_t)sizeof(buffer))
+    {
+        if (entry)
+            free(entry);
+
+        return NULL;
+    }
+
+    memcpy(buffer, path, length);
+    buffer[length] = '\0';
+
+    entry->jar = NULL;
+    entry->jar_path = NULL;
+    entry->directory = NULL;
+    entry->name_table = NULL;
+    entry->name_table_mask = 0;
+    entry->next = NULL;
+    initialize_arena(&entry->memory, CLASS_PATH_NAME_BLOCK_SIZE);
+
+    if (has_suffix(buffer, length, ".jar") || has_suffix(buffer, length, ".zip"))
+    {
+        entry->jar = open_jar_archive(buffer);
+        entry->jar_path = (char*)allocate_from_arena(&entry->memory, length + 1);
+
+        if (!entry->jar || !entry->jar_path)
+        {
+            close_class_path_entry(entry);
+            return NULL;
+        }
+
+        memcpy(entry->jar_path, buffer, length + 1);
+        return entry;
+    }
+
+    if (buffer[length - 1] != '/' && buffer[length - 1] != '\\')
+        buffer[length++] = '/';
+
+    entry->directory = (char*)allocate_from_arena(&entry->memory, length + 1);
+
+    if (!entry->directory)
+    {
+        close_class_path_entry(entry);
+        return NULL;
+    }
+
+    memcpy(entry->directory, buffer, length);
+    entry->directory[length] = '\0';
+
+    if (!index_directory(entry))
+    {
+        close_class_path_entry(entry);
+        return NULL;
+    }
+
+    return entry;
+}
+
+void close_class_path_entry(class_path_entry* entry)
+{
+    if (!entry)
+        return;
+
+    if (entry->jar)
+        close_jar_archive(entry->jar);
+
+    release_arena(&entry->memory);
+    free(entry);
+}
+
+uint8_t class_path_entry_has_class(class_path_entry* entry, const char* name)
+{
+    class_path_name* node;
+    uint16_t length = strlen(name);
+    uint32_t hash;
+
+    // Without a directory index every lookup has to fall back to probing.
+    if (!entry->name_table)
+        return 1;
+
+    hash = utf8_hash((const uint8_t*)name, length);
+
+    for (node = entry->name_table[hash & entry->name_table_mask]; node; node = node->next)
+    {
+        if (node->hash == hash && node->length == length && memcmp(node->name, name, length) == 0)
+            return 1;
+    }
+
+    return 0;
+}
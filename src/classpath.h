@@ -0,0 +1,31 @@
+#ifndef CLASSPATH_H
+#define CLASSPATH_H
+
+#include <stdint.h>
+#include "arena.h"
+#include "jararchive.h"
+
+typedef struct class_path_name
+{
+    uint32_t hash;
+    uint16_t length;
+    char* name;
+    struct class_path_name* next;
+} class_path_name;
+
+typedef struct class_path_entry
+{
+    jar_archive* jar;
+    char* jar_path;
+    char* directory;
+    class_path_name** name_table;
+    uint32_t name_table_mask;
+    arena memory;
+    struct class_path_entry* next;
+} class_path_entry;
+
+class_path_entry* open_class_path_entry(const char*, int32_t);
+void close_class_path_entry(class_path_entry*);
+uint8_t class_path_entry_has_class(class_path_entry*, const char*);
+
+#endif
@@ -0,0 +1,279 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "classprefetch.h"
+#include "arena.h"
+#include "utf8.h"
+
+#define PREFETCH_TABLE_SIZE 1024
+
+enum prefetch_state {
+    PREFETCH_QUEUED,
+    PREFETCH_PARSING,
+    PREFETCH_READY,
+    PREFETCH_TAKEN
+};
+
+typedef struct prefetch_entry
+{
+    symbol* name;
+    uint8_t state;
+    java_class* jc;
+    struct prefetch_entry* hash_next;
+    struct prefetch_entry* queue_next;
+} prefetch_entry;
+
+struct class_prefetcher
+{
+    interpreter_module* virtual_machine;
+    pthread_mutex_t lock;
+    pthread_cond_t work_available;
+    pthread_cond_t class_parsed;
+    pthread_t threads[CLASS_PREFETCH_MAX_THREADS];
+    uint32_t thread_count;
+    uint8_t stopping;
+    prefetch_entry* table[PREFETCH_TABLE_SIZE];
+    prefetch_entry* queue_head;
+    prefetch_entry* queue_tail;
+    arena memory;
+};
+
+static prefetch_entry* find_prefetch_entry(class_prefetcher* prefetcher, symbol* name)
+{
+    prefetch_entry* entry;
+
+    for (entry = prefetcher->table[name->hash & (PREFETCH_TABLE_SIZE - 1)]; entry; entry = entry->hash_next)
+    {
+        if (entry->name == name)
+            return entry;
+    }
+
+    return NULL;
+}
+
+static void* prefetch_worker(void* argument)
+{
+    class_prefetcher* prefetcher = (class_prefetcher*)argument;
+    prefetch_entry* entry;
+    java_class* jc;
+
+    pthread_mutex_lock(&prefetcher->lock);
+
+    while (1)
+    {
+        while (!prefetcher->stopping && !prefetcher->queue_head)
+            pthread_cond_wait(&prefetcher->work_available, &prefetcher->lock);
+
+        if (prefetcher->stopping)
+            break;
+
+        entry = prefetcher->queue_head;
+        prefetcher->queue_head = entry->queue_next;
+
+        if (!prefetcher->queue_head)
+            prefetcher->queue_tail = NULL;
+
+        if (entry->state != PREFETCH_QUEUED)
+            continue;
+
+        entry->state = PREFETCH_PARSING;
+        pthread_mutex_unlock(&prefetcher->lock);
+
+        jc = (java_class*)malloc(sizeof(java_class));
+
+        if (jc)
+            open_class_by_name(prefetcher->virtual_machine, jc, SYMBOL(entry->name));
+
+        pthread_mutex_lock(&prefetcher->lock);
+        entry->jc = jc;
+        entry->state = PREFETCH_READY;
+        pthread_cond_broadcast(&prefetcher->class_parsed);
+    }
+
+    pthread_mutex_unlock(&prefetcher->lock);
+
+    return NULL;
+}
+
+uint32_t get_default_prefetch_thread_count(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (cores > 1)
+        return cores - 1 < 4 ? (uint32_t)(cores - 1) : 4;
+#endif
+
+    return 0;
+}
+
+class_prefetcher* start_class_prefetch(interpreter_module* virtual_machine, uint32_t thread_count)
+{
+    class_prefetcher* prefetcher;
+    uint32_t index;
+
+    if (thread_count == 0)
+        return NULL;
+
+    if (thread_count > CLASS_PREFETCH_MAX_THREADS)
+        thread_count = CLASS_PREFETCH_MAX_THREADS;
+
+    prefetcher = (class_prefetcher*)malloc(sizeof(class_prefetcher));
+
+    if (!prefetcher)
+        return NULL;
+
+    prefetcher->virtual_machine = virtual_machine;
+    prefetcher->thread_count = 0;
+    prefetcher->stopping = 0;
+    prefetcher->queue_head = prefetcher->queue_tail = NULL;
+    initialize_arena(&prefetcher->memory, ARENA_DEFAULT_BLOCK_SIZE);
+
+    for (index = 0; index < PREFETCH_TABLE_SIZE; index++)
+        prefetcher->table[index] = NULL;
+
+    pthread_mutex_init(&prefetcher->lock, NULL);
+    pthread_cond_init(&prefetcher->work_available, NULL);
+    pthread_cond_init(&prefetcher->class_parsed, NULL);
+
+    for (index = 0; index < thread_count; index++)
+    {
+        if (pthread_create(prefetcher->threads + index, NULL, prefetch_worker, prefetcher) != 0)
+            break;
+
+        prefetcher->thread_count++;
+    }
+
+    if (prefetcher->thread_count == 0)
+    {
+        stop_class_prefetch(prefetcher);
+        return NULL;
+    }
+
+    return prefetcher;
+}
+
+void stop_class_prefetch(class_prefetcher* prefetcher)
+{
+    prefetch_entry* entry;
+    uint32_t index;
+
+    pthread_mutex_lock(&prefetcher->lock);
+    prefetcher->stopping = 1;
+    pthread_cond_broadcast(&prefetcher->work_available);
+    pthread_mutex_unlock(&prefetcher->lock);
+
+    for (index = 0; index < prefetcher->thread_count; index++)
+        pthread_join(prefetcher->threads[index], NULL);
+
+    for (index = 0; index < PREFETCH_TABLE_SIZE; index++)
+    {
+        for (entry = prefetcher->table[index]; entry; entry = entry->hash_next)
+        {
+            if (entry->state == PREFETCH_READY && entry->jc)
+            {
+                close_class_file(entry->jc);
+                free(entry->jc);
+            }
+        }
+    }
+
+    pthread_cond_destroy(&prefetcher->class_parsed);
+    pthread_cond_destroy(&prefetcher->work_available);
+    pthread_mutex_destroy(&prefetcher->lock);
+    release_arena(&prefetcher->memory);
+    free(prefetcher);
+}
+
+void prefetch_referenced_classes(class_prefetcher* prefetcher, java_class* jc)
+{
+    interpreter_module* virtual_machine = prefetcher->virtual_machine;
+    constant_pool_info* cpi;
+    prefetch_entry* entry;
+    symbol* name;
+    uint16_t u16;
+    uint8_t queued = 0;
+
+    pthread_mutex_lock(&prefetcher->lock);
+
+    for (u16 = 0; u16 + 1 < jc->constant_pool_count; u16++)
+    {
+        cpi = jc->constant_pool + u16;
+
+        if (cpi->tag == DOUBLE_CONST || cpi->tag == LONG_CONST)
+        {
+            u16++;
+            continue;
+        }
+
+        if (cpi->tag != CLASS_CONST)
+            continue;
+
+        name = jc->constant_pool[cpi->Class.name_index - 1].Utf8.sym;
+
+        // Array descriptors and the simulated String class never reach the
+        // file lookup in class_handler.
+        if (name->length == 0 || *name->bytes == '[' ||
+            (virtual_machine->sys_and_str_classes_simulation && compare_utf8(SYMBOL(name), (const uint8_t*)"java/lang/String", 16)) ||
+            find_loaded_class(virtual_machine, name) || find_prefetch_entry(prefetcher, name))
+        {
+            continue;
+        }
+
+        entry = (prefetch_entry*)allocate_from_arena(&prefetcher->memory, sizeof(prefetch_entry));
+
+        if (!entry)
+            break;
+
+        entry->name = name;
+        entry->state = PREFETCH_QUEUED;
+        entry->jc = NULL;
+        entry->queue_next = NULL;
+        entry->hash_next = prefetcher->table[name->hash & (PREFETCH_TABLE_SIZE - 1)];
+        prefetcher->table[name->hash & (PREFETCH_TABLE_SIZE - 1)] = entry;
+
+        if (prefetcher->queue_tail)
+            prefetcher->queue_tail->queue_next = entry;
+        else
+            prefetcher->queue_head = entry;
+
+        prefetcher->queue_tail = entry;
+        queued = 1;
+    }
+
+    if (queued)
+        pthread_cond_broadcast(&prefetcher->work_available);
+
+    pthread_mutex_unlock(&prefetcher->lock);
+}
+
+java_class* take_prefetched_class(class_prefetcher* prefetcher, const uint8_t* name_bytes, int32_t name_length)
+{
+    symbol* name = lookup_symbol(name_bytes, name_length);
+    prefetch_entry* entry;
+    java_class* jc = NULL;
+
+    if (!name)
+        return NULL;
+
+    pthread_mutex_lock(&prefetcher->lock);
+
+    entry = find_prefetch_entry(prefetcher, name);
+
+    if (entry)
+    {
+        while (entry->state == PREFETCH_PARSING)
+            pthread_cond_wait(&prefetcher->class_parsed, &prefetcher->lock);
+
+        if (entry->state == PREFETCH_READY)
+            jc = entry->jc;
+
+        entry->state = PREFETCH_TAKEN;
+        entry->jc = NULL;
+    }
+
+    pthread_mutex_unlock(&prefetcher->lock);
+
+    return jc;
+}
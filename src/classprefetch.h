@@ -0,0 +1,15 @@
+#ifndef CLASSPREFETCH_H
+#define CLASSPREFETCH_H
+
+#include <stdint.h>
+#include "jvm.h"
+
+#define CLASS_PREFETCH_MAX_THREADS 16
+
+class_prefetcher* start_class_prefetch(interpreter_module*, uint32_t);
+void stop_class_prefetch(class_prefetcher*);
+void prefetch_referenced_classes(class_prefetcher*, java_class*);
+java_class* take_prefetched_class(class_prefetcher*, const uint8_t*, int32_t);
+uint32_t get_default_prefetch_thread_count(void);
+
+#endif
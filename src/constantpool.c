@@ -20,6 +20,16 @@ char read_constant_pool_class(java_class* jc, constant_pool_info* entry)
         return 0;
     }
 
+    entry->Class.resolved_class = NULL;
+    return 1;
+}
+
+char read_constant_pool_string(java_class* jc, constant_pool_info* entry)
+{
+    if (!read_constant_pool_class(jc, entry))
+        return 0;
+
+    entry->String.resolved_string = NULL;
     return 1;
 }
 
@@ -51,6 +61,20 @@ char read_constant_pool_fieldref(java_class* jc, constant_pool_info* entry)
         return 0;
     }
 
+    if (entry->tag == FIELDREF_CONST)
+    {
+        entry->Fieldref.resolved = 0;
+        entry->Fieldref.resolved_class = NULL;
+        entry->Fieldref.resolved_field = NULL;
+    }
+    else if (entry->tag == METHODREF_CONST || entry->tag == INTERFACEMETHODREF_CONST)
+    {
+        entry->Methodref.resolved = 0;
+        entry->Methodref.resolved_class = NULL;
+        entry->Methodref.resolved_method = NULL;
+        entry->Methodref.resolved_target = NULL;
+    }
+
     return 1;
 }
 
@@ -84,77 +108,63 @@ char read_constant_pool_long(java_class* jc, constant_pool_info* entry)
 
 char read_constant_pool_utf8(java_class* jc, constant_pool_info* entry)
 {
+    const uint8_t* bytes;
+    uint16_t i;
+
     if (!read_2_byte_unsigned(jc, &entry->Utf8.length))
     {
         jc->status = UNXPTD_EOF_READING_CP;
         return 0;
     }
 
-    if (entry->Utf8.length > 0)
+    if (!read_byte_span(jc, entry->Utf8.length, &bytes))
     {
-        entry->Utf8.bytes = (uint8_t*)malloc(entry->Utf8.length);
+        jc->status = UNXPTD_EOF_READING_UTF8;
+        return 0;
+    }
 
-        if (!entry->Utf8.bytes)
+    for (i = utf8_ascii_prefix_length(bytes, entry->Utf8.length); i < entry->Utf8.length; i++)
+    {
+        if (bytes[i] == 0 || bytes[i] >= 0xF0)
         {
-            jc->status = MEM_ALLOC_FAILED;
+            jc->status = INV_UTF8_BYTES;
             return 0;
         }
+    }
 
-        uint16_t i;
-        uint8_t* bytes = entry->Utf8.bytes;
-
-        for (i = 0; i < entry->Utf8.length; i++)
-        {
-            int byte = fgetc(jc->file);
-
-            if (byte == EOF)
-            {
-                jc->status = UNXPTD_EOF_READING_UTF8;
-                return 0;
-            }
-
-            jc->total_bytes_read++;
+    entry->Utf8.sym = intern_symbol(bytes, entry->Utf8.length);
 
-            if (byte == 0 || (byte >= 0xF0))
-            {
-                jc->status = INV_UTF8_BYTES;
-                return 0;
-            }
-
-            *bytes++ = (uint8_t)byte;
-        }
-    }
-    else
+    if (!entry->Utf8.sym)
     {
-        entry->Utf8.bytes = NULL;
+        jc->status = MEM_ALLOC_FAILED;
+        return 0;
     }
 
+    entry->Utf8.bytes = (uint8_t*)bytes;
+
     return 1;
 }
 
 char constant_pool_entry_reading(java_class* jc, constant_pool_info* entry)
 {
-    int byte = fgetc(jc->file);
-
-    if (byte == EOF)
+    if (!read_1_byte_unsigned(jc, &entry->tag))
     {
         jc->status = UNXPTD_EOF_READING_CP;
         entry->tag = 0xFF;
         return 0;
     }
 
-    entry->tag = (uint8_t)byte;
-
-    jc->total_bytes_read++;
-    jc->last_tag_read = entry->tag;
+    jc->reader->last_tag_read = entry->tag;
 
     switch(entry->tag)
     {
         case METHODTYPE_CONST:
         case CLASS_CONST:
-        case STRING_CONST:
             return read_constant_pool_class(jc, entry);
 
+        case STRING_CONST:
+            return read_constant_pool_string(jc, entry);
+
         case UTF8_CONST:
             return read_constant_pool_utf8(jc, entry);
 
@@ -175,14 +185,12 @@ char constant_pool_entry_reading(java_class* jc, constant_pool_info* entry)
 
         case METHODHANDLE_CONST:
 
-            if (!read_2_byte_unsigned(jc, NULL) || fgetc(jc->file) == EOF)
+            if (!read_2_byte_unsigned(jc, NULL) || !read_1_byte_unsigned(jc, NULL))
             {
                 jc->status = UNXPTD_EOF_READING_CP;
                 return 0;
             }
 
-            jc->total_bytes_read++;
-
             break;
 
         default:
@@ -2,41 +2,66 @@
 #define CONSTANTPOOL_H
 
 typedef struct constant_pool_info constant_pool_info;
+typedef struct method_signature method_signature;
+struct loaded_classes;
+struct field_info;
+struct method_info;
 
 #include <stdint.h>
 #include "javaclass.h"
+#include "symboltable.h"
 
 struct constant_pool_info {
     uint8_t tag;
 
     union {
 
+        // resolved_class is set once a new through this entry is quickened.
         struct {
             uint16_t name_index;
+            struct loaded_classes* resolved_class;
         } Class;
 
+        // resolved_string is the interned literal, set by the first ldc.
         struct {
             uint16_t string_index;
+            struct reference* resolved_string;
         } String;
 
+        // The three member references share this layout. Once the class and
+        // every class named in the descriptor are loaded, resolved is set and
+        // resolved_class caches the declaring class. The resolved member is
+        // filled in when an instruction using the entry is quickened.
         struct {
             uint16_t class_index;
             uint16_t name_and_type_index;
+            uint8_t resolved;
+            struct loaded_classes* resolved_class;
+            struct field_info* resolved_field;
         } Fieldref;
 
         struct {
             uint16_t class_index;
             uint16_t name_and_type_index;
+            uint8_t resolved;
+            struct loaded_classes* resolved_class;
+            struct method_info* resolved_method;
+            java_class* resolved_target;
         } Methodref;
 
         struct {
             uint16_t class_index;
             uint16_t name_and_type_index;
+            uint8_t resolved;
+            struct loaded_classes* resolved_class;
+            struct method_info* resolved_method;
+            java_class* resolved_target;
         } InterfaceMethodref;
 
         struct {
             uint16_t name_index;
             uint16_t descriptor_index;
+            method_signature* signature;
         } NameAndType;
 
         struct {
@@ -60,12 +85,23 @@ struct constant_pool_info {
         struct {
             uint16_t length;
             uint8_t* bytes;
+            symbol* sym;
         } Utf8;
 
     };
 
 };
 
+// Argument and return kinds are the descriptor's type characters ('[' and
+// 'L' for references, 'V' for a void return), so a long or double argument
+// takes two slots.
+struct method_signature {
+    uint8_t argument_count;
+    uint8_t argument_slots;
+    uint8_t return_kind;
+    uint8_t* argument_kinds;
+};
+
 enum constant_pool_tag {
     UTF8_CONST = 1,
     INT_CONST = 3,
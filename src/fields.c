@@ -7,17 +7,18 @@
 char fieald_read(java_class* jc, field_info* entry)
 {
     entry->attributes = NULL;
-    jc->attribute_entries_read = -1;
+    jc->reader->attribute_entries_read = -1;
 
     if (!read_2_byte_unsigned(jc, &entry->access_flags) || !read_2_byte_unsigned(jc, &entry->name_index) || !read_2_byte_unsigned(jc, &entry->descriptor_index) || !read_2_byte_unsigned(jc, &entry->attributes_count)) {
         jc->status = UNXPTD_EOF;
         return 0;
     }
 
-    if (!check_access_flags_field(jc, entry->access_flags))
+    if (!jc->reader->verified_image && !check_access_flags_field(jc, entry->access_flags))
         return 0;
 
-    if (entry->name_index == 0 || entry->name_index >= jc->constant_pool_count || !name_idx_is_valid(jc, entry->name_index, 0))
+    if (entry->name_index == 0 || entry->name_index >= jc->constant_pool_count ||
+        (!jc->reader->verified_image && !name_idx_is_valid(jc, entry->name_index, 0)))
     {
         jc->status = INV_NAME_IDX;
         return 0;
@@ -26,14 +27,14 @@ char fieald_read(java_class* jc, field_info* entry)
     constant_pool_info* cpi = jc->constant_pool + entry->descriptor_index - 1;
 
     if (entry->descriptor_index == 0 || entry->descriptor_index >= jc->constant_pool_count || cpi->tag != UTF8_CONST ||
-        cpi->Utf8.length != read_field_descriptor(cpi->Utf8.bytes, cpi->Utf8.length, 1)) {
+        (!jc->reader->verified_image && cpi->Utf8.length != read_field_descriptor(cpi->Utf8.bytes, cpi->Utf8.length, 1))) {
         jc->status = INV_FIELD_DESC_IDX;
         return 0;
     }
 
     if (entry->attributes_count > 0)
     {
-        entry->attributes = (attribute_info*)malloc(sizeof(attribute_info) * entry->attributes_count);
+        entry->attributes = (attribute_info*)allocate_from_arena(&jc->memory, sizeof(attribute_info) * entry->attributes_count);
 
         if (!entry->attributes)
         {
@@ -43,7 +44,7 @@ char fieald_read(java_class* jc, field_info* entry)
 
         uint16_t i;
 
-        jc->attribute_entries_read = 0;
+        jc->reader->attribute_entries_read = 0;
 
         for (i = 0; i < entry->attributes_count; i++)
         {
@@ -53,29 +54,13 @@ char fieald_read(java_class* jc, field_info* entry)
                 return 0;
             }
 
-            jc->attribute_entries_read++;
+            jc->reader->attribute_entries_read++;
         }
     }
 
     return 1;
 }
 
-void free_field_attributes(field_info* entry)
-{
-    uint32_t i;
-
-    if (entry->attributes != NULL)
-    {
-        for (i = 0; i < entry->attributes_count; i++)
-            free_attribute_info(entry->attributes + i);
-
-        free(entry->attributes);
-
-        entry->attributes_count = 0;
-        entry->attributes = NULL;
-    }
-}
-
 void print_all_fields(java_class* jc)
 {
     if (jc->field_count == 0)
@@ -126,28 +111,168 @@ void print_all_fields(java_class* jc)
     printf("\n");
 }
 
-field_info* get_maching_field(java_class* jc, const uint8_t* name, int32_t name_len, const uint8_t* descriptor, int32_t descriptor_len, uint16_t flag_mask) {
-    field_info* field = jc->fields;
-    constant_pool_info* cpi;
+uint8_t get_field_size(java_class* jc, field_info* field)
+{
+    switch (*jc->constant_pool[field->descriptor_index - 1].Utf8.bytes)
+    {
+        case 'J': case 'D': return 8;
+        case 'C': case 'S': return 2;
+        case 'B': case 'Z': return 1;
+
+        // int, float and references, which are stored as int32_t.
+        default: return 4;
+    }
+}
+
+#define ALIGN_FIELD(offset, size) (((offset) + (size) - 1) & ~(uint32_t)((size) - 1))
+
+// Instance fields start where the superclass's fields end and are placed largest
+// first, each aligned to its own size. When the first 8-byte field needs
+// padding, smaller fields are moved into the gap.
+uint8_t layout_instance_fields(java_class* jc, java_class* super)
+{
+    static const uint8_t sizes[] = {8, 4, 2, 1};
+    uint32_t counts[9] = {0};
+    uint32_t gap_counts[9] = {0};
+    uint32_t placed[9] = {0};
+    uint32_t start = super ? super->instance_size : 0;
+    uint32_t gap_end, gap_offset, offset;
+    uint16_t u16;
+    uint8_t index, size;
+    field_info* field;
+
+    for (u16 = 0; u16 < jc->field_count; u16++)
+    {
+        if (!(jc->fields[u16].access_flags & STATIC_ACCESS_FLAG))
+            counts[get_field_size(jc, jc->fields + u16)]++;
+    }
+
+    gap_end = counts[8] ? ALIGN_FIELD(start, 8) : start;
+    gap_offset = start;
+
+    for (index = 1; index < sizeof(sizes); index++)
+    {
+        size = sizes[index];
+
+        while (gap_counts[size] < counts[size] && ALIGN_FIELD(gap_offset, size) + size <= gap_end)
+        {
+            gap_offset = ALIGN_FIELD(gap_offset, size) + size;
+            gap_counts[size]++;
+        }
+    }
+
+    gap_offset = start;
+    offset = gap_end;
+
+    for (index = 0; index < sizeof(sizes); index++)
+    {
+        size = sizes[index];
+
+        for (u16 = 0; u16 < jc->field_count; u16++)
+        {
+            field = jc->fields + u16;
+
+            if ((field->access_flags & STATIC_ACCESS_FLAG) || get_field_size(jc, field) != size)
+                continue;
+
+            if (placed[size]++ < gap_counts[size])
+            {
+                gap_offset = ALIGN_FIELD(gap_offset, size);
+                field->offset = gap_offset;
+                gap_offset += size;
+            }
+            else
+            {
+                offset = ALIGN_FIELD(offset, size);
+
+                if (offset + size > UINT16_MAX)
+                    return 0;
+
+                field->offset = offset;
+                offset += size;
+            }
+        }
+    }
+
+    jc->instance_size = offset;
+    return 1;
+}
+
+uint8_t build_field_index(java_class* jc)
+{
+    uint32_t size = 4;
     uint16_t index;
+    field_info* field;
+    constant_pool_info* name;
+    constant_pool_info* descriptor;
+
+    if (jc->field_count == 0)
+        return 1;
+
+    while (size < (uint32_t)jc->field_count * 2)
+        size <<= 1;
+
+    jc->field_index = (member_index_entry*)allocate_zeroed_from_arena(&jc->memory, size * sizeof(member_index_entry));
 
-    for (index = jc->field_count; index > 0; index--, field++)
+    if (!jc->field_index)
+        return 0;
+
+    jc->field_index_mask = size - 1;
+
+    for (index = 0; index < jc->field_count; index++)
     {
-        if ((field->access_flags & flag_mask) != flag_mask)
-            continue;
+        field = jc->fields + index;
+        name = jc->constant_pool + field->name_index - 1;
+        descriptor = jc->constant_pool + field->descriptor_index - 1;
+
+        uint32_t hash = MEMBER_HASH(name->Utf8.sym->hash, descriptor->Utf8.sym->hash);
+        uint32_t slot = hash & jc->field_index_mask;
 
-        cpi = jc->constant_pool + field->name_index - 1;
-        if (!compare_ascii_utf8(cpi->Utf8.bytes, cpi->Utf8.length, name, name_len))
-            continue;
+        while (jc->field_index[slot].index)
+            slot = (slot + 1) & jc->field_index_mask;
 
-    
-        cpi = jc->constant_pool + field->descriptor_index - 1;
-        if (!compare_ascii_utf8(cpi->Utf8.bytes, cpi->Utf8.length, descriptor, descriptor_len))
-            continue;
+        jc->field_index[slot].hash = hash;
+        jc->field_index[slot].index = index + 1;
+    }
+
+    return 1;
+}
+
+static field_info* find_field(java_class* jc, symbol* name, symbol* descriptor, uint16_t flag_mask)
+{
+    if (!jc->field_index || !name || !descriptor)
+        return NULL;
 
+    uint32_t hash = MEMBER_HASH(name->hash, descriptor->hash);
+    uint32_t slot = hash & jc->field_index_mask;
+    member_index_entry* entry;
+    field_info* field;
 
-        return field;
+    for (entry = jc->field_index + slot; entry->index; entry = jc->field_index + slot)
+    {
+        if (entry->hash == hash)
+        {
+            field = jc->fields + entry->index - 1;
+
+            if (jc->constant_pool[field->name_index - 1].Utf8.sym == name &&
+                jc->constant_pool[field->descriptor_index - 1].Utf8.sym == descriptor)
+            {
+                return (field->access_flags & flag_mask) == flag_mask ? field : NULL;
+            }
+        }
+
+        slot = (slot + 1) & jc->field_index_mask;
     }
 
     return NULL;
 }
+
+field_info* get_maching_field(java_class* jc, const uint8_t* name, int32_t name_len, const uint8_t* descriptor, int32_t descriptor_len, uint16_t flag_mask)
+{
+    return find_field(jc, lookup_symbol(name, name_len), lookup_symbol(descriptor, descriptor_len), flag_mask);
+}
+
+field_info* get_field_by_name_and_type(java_class* jc, constant_pool_info* name, constant_pool_info* descriptor, uint16_t flag_mask)
+{
+    return find_field(jc, name->Utf8.sym, descriptor->Utf8.sym, flag_mask);
+}
@@ -13,13 +13,19 @@ struct field_info {
     uint16_t descriptor_index;
     uint16_t attributes_count;
     attribute_info* attributes;
+    // Byte offset into the instance for instance fields, int32_t slot
+    // index into the class's static data for static ones.
     uint16_t offset;
 };
 
 char fieald_read(java_class*, field_info*);
-void free_field_attributes(field_info*);
 void print_all_fields(java_class*);
+uint8_t build_field_index(java_class*);
+uint8_t get_field_size(java_class*, field_info*);
+uint8_t layout_instance_fields(java_class*, java_class*);
 field_info* get_maching_field(java_class*, const uint8_t*, int32_t,
         const uint8_t*, int32_t, uint16_t);
+field_info* get_field_by_name_and_type(java_class*, constant_pool_info*,
+        constant_pool_info*, uint16_t);
 
 #endif
@@ -5,35 +5,36 @@ frame* create_new_frame(java_class* jc, method_info* method) {
 
     if (fr)
     {
-        attribute_info* codeAttribute = get_attribute_using_type(method->attributes, method->attributes_count, ATTRIBUTE_Code);
-        attr_code_info* code;
+        attr_code_info* code = get_method_code(jc, method);
 
-        if (codeAttribute)
+        if (code)
         {
-            code = (attr_code_info*)codeAttribute->info;
             fr->bytecode = code->code;
             fr->bytecode_length = code->code_length;
 
-            if (code->max_locals > 0)
-                fr->local_vars = (int32_t*)malloc(code->max_locals * sizeof(int32_t));
+            // Each local keeps the operand type it was stored with, so the
+            // garbage collector knows which locals hold references.
+            if (method->max_locals > 0)
+                fr->local_vars = (int32_t*)calloc(method->max_locals, sizeof(int32_t) + sizeof(uint8_t));
             else
                 fr->local_vars = NULL;
 
-#ifdef DEBUG
-            fr->max_locals = code->max_locals;
-#endif
-
+            fr->local_types = fr->local_vars ? (uint8_t*)(fr->local_vars + method->max_locals) : NULL;
+            fr->max_locals = fr->local_vars ? method->max_locals : 0;
         }
         else
         {
             fr->bytecode = NULL;
             fr->bytecode_length = 0;
             fr->local_vars = NULL;
+            fr->local_types = NULL;
+            fr->max_locals = 0;
         }
 
         fr->operands = NULL;
         fr->jc = jc;
         fr->PC = 0;
+        fr->return_count = 0;
     }
 
     return fr;
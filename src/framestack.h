@@ -15,10 +15,8 @@ struct frame {
     uint8_t* bytecode;
     stack_operand* operands;
     int32_t* local_vars;
-
-#ifdef DEBUG
+    uint8_t* local_types;
     uint16_t max_locals;
-#endif
 };
 
 struct stack_frame {
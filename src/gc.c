@@ -0,0 +1,1399 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "gc.h"
+
+// Objects are reachable from the operand stacks and typed locals of every
+// frame and from static fields. Collection only runs between instructions,
+// so no reference can be held in a C local while it does.
+//
+// Young objects live in the nursery and are copied out by a Cheney scan on
+// every collection, so a survivor is promoted on its first collection. The
+// old generation is only marked and swept once it reaches its threshold.
+// Its regions are walked object by object using their sizes; sweeping merges
+// dead neighbours into free chunks and releases regions left empty.
+//
+// Old generation marking is incremental and snapshot-at-the-beginning: roots
+// are marked in the pause that starts the cycle (right after emptying the
+// nursery), every reference overwritten in an object while marking is shaded
+// by the write barrier, and objects promoted or allocated while marking are
+// black. Sweeping is incremental too; objects allocated meanwhile are kept
+// out of the regions being swept.
+//
+// With helper threads, a step that has enough gray objects marks them in
+// parallel. Each thread drains a private stack without locking and, while
+// another thread is idle, publishes a batch on a shared stack for it to
+// steal. Sweep steps hand out whole regions.
+
+#define GC_ALIGN(size) (((size) + 7) & ~(uint32_t)7)
+
+#define GC_REGION_SIZE (256 * 1024)
+
+// Objects that get a region of their own.
+#define GC_LARGE_OBJECT_SIZE (GC_REGION_SIZE / 4)
+
+#define GC_MIN_CHUNK_SIZE GC_ALIGN(sizeof(reference))
+#define REGION_START(region) ((uint8_t*)(region) + GC_ALIGN(sizeof(gc_region)))
+
+// Sizes below the last list each have a list of their own.
+#define FREE_LIST_INDEX(size) ((size) / 8 < GC_FREE_LISTS - 1 ? (size) / 8 : GC_FREE_LISTS - 1)
+
+// Objects processed between two looks at the clock.
+#define GC_WORK_QUANTUM 64
+
+// Allocation that brings on the next step of a running cycle.
+#define GC_STEP_ALLOCATION (64 * 1024)
+
+// Gray objects needed before marking is shared with the helper threads.
+#define GC_PARALLEL_MARK_MIN 256
+
+// Gray objects taken from another thread's stack at a time.
+#define GC_STEAL_BATCH 64
+
+enum gc_task {
+    GC_TASK_MARK,
+    GC_TASK_SWEEP
+};
+
+// Only the owner touches the local stack. The shared stack holds work
+// published for other threads and is guarded by the lock.
+typedef struct gc_worker_queue
+{
+    struct gc_workers* workers;
+    uint32_t index;
+    reference_list local;
+    pthread_mutex_t lock;
+    reference_list shared;
+} gc_worker_queue;
+
+// Queue 0 belongs to the interpreter thread, which works on every task
+// alongside the helpers.
+struct gc_workers
+{
+    interpreter_module* virtual_machine;
+    pthread_mutex_t lock;
+    pthread_cond_t work_available;
+    pthread_cond_t work_done;
+    pthread_t threads[GC_MAX_THREADS];
+    uint32_t thread_count;
+    uint32_t generation;
+    uint32_t running;
+    uint8_t stopping;
+    uint8_t task;
+    uint64_t deadline;
+    uint32_t idle;
+    uint8_t out_of_time;
+    gc_worker_queue queues[GC_MAX_THREADS];
+};
+
+static void stop_gc_workers(gc_workers*);
+
+static uint8_t field_holds_reference(java_class* jc, field_info* field)
+{
+    uint8_t descriptor = *jc->constant_pool[field->descriptor_index - 1].Utf8.bytes;
+
+    return descriptor == 'L' || descriptor == '[';
+}
+
+uint8_t build_reference_slots(java_class* jc, java_class* super)
+{
+    uint16_t count = super ? super->reference_slot_count : 0;
+    uint16_t index;
+    field_info* field;
+
+    for (index = 0; index < jc->field_count; index++)
+    {
+        field = jc->fields + index;
+
+        if (!(field->access_flags & STATIC_ACCESS_FLAG) && field_holds_reference(jc, field))
+            count++;
+    }
+
+    jc->reference_slot_count = 0;
+    jc->reference_slots = NULL;
+
+    if (count == 0)
+        return 1;
+
+    jc->reference_slots = (uint16_t*)allocate_from_arena(&jc->memory, count * sizeof(uint16_t));
+
+    if (!jc->reference_slots)
+        return 0;
+
+    for (index = 0; super && index < super->reference_slot_count; index++)
+        jc->reference_slots[jc->reference_slot_count++] = super->reference_slots[index];
+
+    for (index = 0; index < jc->field_count; index++)
+    {
+        field = jc->fields + index;
+
+        if (!(field->access_flags & STATIC_ACCESS_FLAG) && field_holds_reference(jc, field))
+            jc->reference_slots[jc->reference_slot_count++] = field->offset;
+    }
+
+    return 1;
+}
+
+uint32_t get_reference_size(reference* obj)
+{
+    uint32_t size = sizeof(reference);
+
+    switch (obj->type)
+    {
+        case REF_TYPE_STRING:
+            if (!obj->str.constant_bytes)
+                size += obj->str.len;
+            break;
+
+        case REF_TYPE_CLASSINSTANCE:
+            size += obj->ci.c->instance_size;
+            break;
+
+        case REF_TYPE_OBJECTARRAY:
+            size += obj->oar.length * sizeof(reference*) + obj->oar.utf8_len;
+            break;
+
+        case REF_TYPE_ARRAY:
+            switch (obj->arr.type)
+            {
+                case T_SHORT: case T_CHAR: size += obj->arr.length * sizeof(uint16_t); break;
+                case T_FLOAT: case T_INT: size += obj->arr.length * sizeof(uint32_t); break;
+                case T_DOUBLE: case T_LONG: size += obj->arr.length * sizeof(uint64_t); break;
+                default: size += obj->arr.length; break;
+            }
+            break;
+
+        case REF_TYPE_FREE:
+            return obj->chunk.size;
+    }
+
+    return size;
+}
+
+static uint32_t get_chunk_size(reference* obj)
+{
+    return obj->type == REF_TYPE_FREE ? obj->chunk.size : GC_ALIGN(get_reference_size(obj));
+}
+
+// Returns the object after obj in the region (the first one when obj is
+// NULL), stepping over free chunks.
+static reference* next_old_object(gc_region* region, reference* obj)
+{
+    uint8_t* position = obj ? (uint8_t*)obj + get_chunk_size(obj) : REGION_START(region);
+
+    while (position < region->top && ((reference*)position)->type == REF_TYPE_FREE)
+        position += ((reference*)position)->chunk.size;
+
+    return position < region->top ? (reference*)position : NULL;
+}
+
+static uint8_t push_reference(reference_list* list, reference* obj)
+{
+    if (list->count == list->capacity)
+    {
+        uint32_t capacity = list->capacity ? list->capacity * 2 : 256;
+        reference** entries = (reference**)realloc(list->entries, capacity * sizeof(reference*));
+
+        if (!entries)
+            return 0;
+
+        list->entries = entries;
+        list->capacity = capacity;
+    }
+
+    list->entries[list->count++] = obj;
+    return 1;
+}
+
+static uint8_t has_references(reference* obj)
+{
+    return obj->type == REF_TYPE_CLASSINSTANCE || obj->type == REF_TYPE_OBJECTARRAY;
+}
+
+// Marked objects on the mark stack are gray, the rest black. When the stack
+// cannot grow, the object stays marked but its fields are only found by
+// rescanning every marked object.
+static void mark_reference(gc_heap* heap, reference* obj)
+{
+    if (!obj || obj->marked || IS_YOUNG_REFERENCE(heap, obj))
+        return;
+
+    obj->marked = 1;
+
+    // Strings and primitive arrays hold no references and never need scanning.
+    if (has_references(obj) && !push_reference(&heap->mark_stack, obj))
+        heap->mark_overflow = 1;
+}
+
+static reference* make_free_chunk(uint8_t* start, uint32_t size)
+{
+    reference* chunk = (reference*)start;
+
+    chunk->type = REF_TYPE_FREE;
+    chunk->marked = 0;
+    chunk->remembered = 0;
+    chunk->chunk.size = size;
+    chunk->chunk.next = NULL;
+
+    return chunk;
+}
+
+static void add_free_chunk(gc_heap* heap, reference* chunk)
+{
+    uint32_t index = FREE_LIST_INDEX(chunk->chunk.size);
+
+    chunk->chunk.next = heap->free_lists[index];
+    heap->free_lists[index] = chunk;
+}
+
+static reference* take_free_chunk(gc_heap* heap, uint32_t size)
+{
+    uint32_t index = FREE_LIST_INDEX(size);
+    reference** link;
+    reference* chunk;
+
+    if (index < GC_FREE_LISTS - 1 && heap->free_lists[index])
+    {
+        chunk = heap->free_lists[index];
+        heap->free_lists[index] = chunk->chunk.next;
+        return chunk;
+    }
+
+    // First fit among the large chunks. What is split off has to be big
+    // enough to be walked over as a chunk of its own.
+    for (link = heap->free_lists + GC_FREE_LISTS - 1; *link; link = &(*link)->chunk.next)
+    {
+        chunk = *link;
+
+        if (chunk->chunk.size == size || chunk->chunk.size >= size + GC_MIN_CHUNK_SIZE)
+        {
+            *link = chunk->chunk.next;
+
+            if (chunk->chunk.size > size)
+                add_free_chunk(heap, make_free_chunk((uint8_t*)chunk + size, chunk->chunk.size - size));
+
+            return chunk;
+        }
+    }
+
+    return NULL;
+}
+
+static gc_region* add_region(gc_heap* heap, uint32_t size)
+{
+    gc_region* region = (gc_region*)malloc(GC_ALIGN(sizeof(gc_region)) + size);
+
+    if (!region)
+        return NULL;
+
+    region->top = REGION_START(region);
+    region->end = region->top + size;
+    region->next = heap->regions;
+    heap->regions = region;
+
+    return region;
+}
+
+static reference* allocate_old_reference(interpreter_module* virtual_machine, uint32_t size)
+{
+    gc_heap* heap = &virtual_machine->heap;
+    uint32_t aligned = GC_ALIGN(size);
+    gc_region* region;
+    reference* obj = NULL;
+
+    if (aligned >= GC_LARGE_OBJECT_SIZE)
+    {
+        region = add_region(heap, aligned);
+    }
+    else
+    {
+        obj = take_free_chunk(heap, aligned);
+        region = heap->allocation_region;
+
+        if (!obj && (!region || (uint32_t)(region->end - region->top) < aligned))
+            region = heap->allocation_region = add_region(heap, GC_REGION_SIZE);
+    }
+
+    if (!obj)
+    {
+        if (!region)
+            return NULL;
+
+        obj = (reference*)region->top;
+        region->top += aligned;
+    }
+
+    memset(obj, 0, aligned);
+    obj->marked = heap->phase == GC_MARKING;
+    heap->used += aligned;
+
+    if (heap->used >= heap->threshold)
+        heap->collect_requested = 1;
+
+    return obj;
+}
+
+reference* allocate_reference(interpreter_module* virtual_machine, reference_type type, uint32_t payload_size)
+{
+    gc_heap* heap = &virtual_machine->heap;
+    uint32_t size = sizeof(reference) + payload_size;
+    uint32_t aligned = GC_ALIGN(size);
+    reference* obj;
+
+    if (payload_size > GC_MAX_PAYLOAD_SIZE)
+        return NULL;
+
+    if (heap->phase != GC_IDLE && (heap->step_allocated += aligned) >= GC_STEP_ALLOCATION)
+        heap->collect_requested = 1;
+
+    // Large objects go straight to the old generation so they are never copied.
+    if (aligned <= (uint32_t)(heap->nursery_end - heap->nursery) / 8)
+    {
+        if (aligned <= (uint32_t)(heap->nursery_end - heap->nursery_top))
+        {
+            obj = (reference*)heap->nursery_top;
+            heap->nursery_top += aligned;
+            memset(obj, 0, size);
+            obj->type = type;
+            return obj;
+        }
+
+        heap->nursery_full = 1;
+        heap->collect_requested = 1;
+    }
+
+    obj = allocate_old_reference(virtual_machine, size);
+
+    if (obj)
+        obj->type = type;
+
+    return obj;
+}
+
+reference* allocate_tenured_reference(interpreter_module* virtual_machine, reference_type type, uint32_t payload_size)
+{
+    reference* obj;
+
+    if (payload_size > GC_MAX_PAYLOAD_SIZE)
+        return NULL;
+
+    obj = allocate_old_reference(virtual_machine, sizeof(reference) + payload_size);
+
+    if (obj)
+        obj->type = type;
+
+    return obj;
+}
+
+void remember_reference_store(interpreter_module* virtual_machine, reference* holder, reference* previous, reference* value)
+{
+    gc_heap* heap = &virtual_machine->heap;
+
+    if (heap->phase == GC_MARKING)
+        mark_reference(heap, previous);
+
+    if (!value || holder->remembered || !IS_YOUNG_REFERENCE(heap, value) || IS_YOUNG_REFERENCE(heap, holder))
+        return;
+
+    holder->remembered = 1;
+
+    // Without room to record the holder, the next minor collection has to
+    // scan every old object instead.
+    if (!push_reference(&heap->remembered, holder))
+        heap->remembered_overflow = 1;
+}
+
+void remember_static_store(interpreter_module* virtual_machine, loaded_classes* lc, reference* value)
+{
+    if (value && IS_YOUNG_REFERENCE(&virtual_machine->heap, value))
+        lc->statics_remembered = 1;
+}
+
+void set_heap_size(interpreter_module* virtual_machine, uint32_t size)
+{
+    gc_heap* heap = &virtual_machine->heap;
+    uint32_t nursery_size = GC_ALIGN(size / 8);
+
+    if (nursery_size > GC_MAX_NURSERY_SIZE)
+        nursery_size = GC_MAX_NURSERY_SIZE;
+
+    // Only called before the first allocation, so the nursery holds nothing.
+    free(heap->nursery);
+    heap->nursery = nursery_size ? (uint8_t*)malloc(nursery_size) : NULL;
+    heap->nursery_top = heap->nursery;
+    heap->nursery_end = heap->nursery ? heap->nursery + nursery_size : NULL;
+
+    heap->size = heap->nursery ? size - nursery_size : size;
+    heap->threshold = heap->size < GC_MIN_THRESHOLD ? heap->size : GC_MIN_THRESHOLD;
+}
+
+void set_pause_target(interpreter_module* virtual_machine, uint32_t milliseconds)
+{
+    virtual_machine->heap.pause_target = milliseconds * 1000;
+}
+
+void release_heap(interpreter_module* virtual_machine)
+{
+    gc_heap* heap = &virtual_machine->heap;
+    gc_region* region;
+    uint32_t index;
+
+    if (heap->workers)
+    {
+        stop_gc_workers(heap->workers);
+        heap->workers = NULL;
+    }
+
+    while (heap->regions || heap->sweep_regions)
+    {
+        region = heap->regions ? heap->regions : heap->sweep_regions;
+
+        if (region == heap->regions)
+            heap->regions = region->next;
+        else
+            heap->sweep_regions = region->next;
+
+        free(region);
+    }
+
+    heap->allocation_region = NULL;
+
+    for (index = 0; index < GC_FREE_LISTS; index++)
+        heap->free_lists[index] = NULL;
+
+    free(heap->nursery);
+    free(heap->remembered.entries);
+    free(heap->mark_stack.entries);
+
+    heap->nursery = heap->nursery_top = heap->nursery_end = NULL;
+    heap->remembered.entries = heap->mark_stack.entries = NULL;
+    heap->remembered.count = heap->remembered.capacity = 0;
+    heap->mark_stack.count = heap->mark_stack.capacity = 0;
+    heap->phase = GC_IDLE;
+}
+
+static uint8_t evacuate(interpreter_module* virtual_machine, reference_list* queue, reference** slot)
+{
+    reference* obj = *slot;
+    reference* copy;
+    uint32_t size;
+
+    if (!obj || !IS_YOUNG_REFERENCE(&virtual_machine->heap, obj))
+        return 1;
+
+    if (obj->forwarded)
+    {
+        *slot = obj->forwardee;
+        return 1;
+    }
+
+    size = get_reference_size(obj);
+    copy = allocate_old_reference(virtual_machine, size);
+
+    if (!copy)
+        return 0;
+
+    memcpy(copy, obj, size);
+    copy->marked = virtual_machine->heap.phase == GC_MARKING;
+
+    obj->forwarded = 1;
+    obj->forwardee = copy;
+    *slot = copy;
+
+    return !has_references(copy) || push_reference(queue, copy);
+}
+
+static uint8_t evacuate_slot(interpreter_module* virtual_machine, reference_list* queue, int32_t* slot)
+{
+    reference* obj = (reference*)*slot;
+
+    if (!evacuate(virtual_machine, queue, &obj))
+        return 0;
+
+    *slot = (int32_t)obj;
+    return 1;
+}
+
+static uint8_t evacuate_fields(interpreter_module* virtual_machine, reference_list* queue, reference* obj)
+{
+    uint32_t index;
+
+    if (obj->type == REF_TYPE_CLASSINSTANCE)
+    {
+        for (index = 0; index < obj->ci.c->reference_slot_count; index++)
+        {
+            if (!evacuate_slot(virtual_machine, queue, (int32_t*)(INSTANCE_FIELDS(obj) + obj->ci.c->reference_slots[index])))
+                return 0;
+        }
+    }
+    else if (obj->type == REF_TYPE_OBJECTARRAY)
+    {
+        for (index = 0; index < obj->oar.length; index++)
+        {
+            if (!evacuate(virtual_machine, queue, OBJECT_ARRAY_ELEMENTS(obj) + index))
+                return 0;
+        }
+    }
+
+    return 1;
+}
+
+static uint8_t evacuate_roots(interpreter_module* virtual_machine, reference_list* queue)
+{
+    gc_heap* heap = &virtual_machine->heap;
+    stack_frame* frames;
+    stack_operand* operand;
+    loaded_classes* lc;
+    gc_region* regions[2];
+    gc_region* region;
+    reference* obj;
+    field_info* field;
+    frame* fr;
+    uint32_t index;
+
+    for (frames = virtual_machine->frames; frames; frames = frames->next)
+    {
+        fr = frames->fr;
+
+        for (operand = fr->operands; operand; operand = operand->next)
+        {
+            if (operand->type == REF_OP && !evacuate_slot(virtual_machine, queue, &operand->value))
+                return 0;
+        }
+
+        for (index = 0; index < fr->max_locals; index++)
+        {
+            if (fr->local_types[index] == REF_OP && !evacuate_slot(virtual_machine, queue, fr->local_vars + index))
+                return 0;
+        }
+    }
+
+    for (lc = virtual_machine->classes; lc; lc = lc->next)
+    {
+        if (!lc->statics_remembered)
+            continue;
+
+        for (index = 0; index < lc->jc->field_count; index++)
+        {
+            field = lc->jc->fields + index;
+
+            if (!(field->access_flags & STATIC_ACCESS_FLAG) || !field_holds_reference(lc->jc, field))
+                continue;
+
+            if (!evacuate_slot(virtual_machine, queue, lc->static_data + field->offset))
+                return 0;
+        }
+
+        lc->statics_remembered = 0;
+    }
+
+    if (heap->remembered_overflow)
+    {
+        // Objects promoted during this walk may be met again; scanning
+        // them twice does no harm.
+        regions[0] = heap->regions;
+        regions[1] = heap->sweep_regions;
+
+        for (index = 0; index < 2; index++)
+        {
+            for (region = regions[index]; region; region = region->next)
+            {
+                for (obj = next_old_object(region, NULL); obj; obj = next_old_object(region, obj))
+                {
+                    obj->remembered = 0;
+
+                    if (!evacuate_fields(virtual_machine, queue, obj))
+                        return 0;
+                }
+            }
+        }
+    }
+    else
+    {
+        for (index = 0; index < heap->remembered.count; index++)
+        {
+            heap->remembered.entries[index]->remembered = 0;
+
+            if (!evacuate_fields(virtual_machine, queue, heap->remembered.entries[index]))
+                return 0;
+        }
+    }
+
+    return 1;
+}
+
+static uint8_t collect_nursery(interpreter_module* virtual_machine)
+{
+    gc_heap* heap = &virtual_machine->heap;
+    reference_list queue = {NULL, 0, 0};
+    uint32_t scan;
+    uint8_t success;
+
+    heap->nursery_full = 0;
+
+    if (heap->nursery_top == heap->nursery)
+        return 1;
+
+    success = evacuate_roots(virtual_machine, &queue);
+
+    // Promoted objects are appended to the queue while it is being scanned.
+    for (scan = 0; success && scan < queue.count; scan++)
+        success = evacuate_fields(virtual_machine, &queue, queue.entries[scan]);
+
+    free(queue.entries);
+
+    heap->nursery_top = heap->nursery;
+    heap->remembered.count = 0;
+    heap->remembered_overflow = 0;
+
+    return success;
+}
+
+static void mark_fields(gc_heap* heap, reference* obj)
+{
+    uint32_t index;
+
+    if (obj->type == REF_TYPE_CLASSINSTANCE)
+    {
+        for (index = 0; index < obj->ci.c->reference_slot_count; index++)
+            mark_reference(heap, (reference*)*(int32_t*)(INSTANCE_FIELDS(obj) + obj->ci.c->reference_slots[index]));
+    }
+    else if (obj->type == REF_TYPE_OBJECTARRAY)
+    {
+        for (index = 0; index < obj->oar.length; index++)
+            mark_reference(heap, OBJECT_ARRAY_ELEMENTS(obj)[index]);
+    }
+}
+
+static void mark_roots(interpreter_module* virtual_machine)
+{
+    gc_heap* heap = &virtual_machine->heap;
+    stack_frame* frames;
+    stack_operand* operand;
+    loaded_classes* lc;
+    field_info* field;
+    frame* fr;
+    uint16_t index;
+    uint32_t slot;
+
+    for (frames = virtual_machine->frames; frames; frames = frames->next)
+    {
+        fr = frames->fr;
+
+        for (operand = fr->operands; operand; operand = operand->next)
+        {
+            if (operand->type == REF_OP)
+                mark_reference(heap, (reference*)operand->value);
+        }
+
+        for (index = 0; index < fr->max_locals; index++)
+        {
+            if (fr->local_types[index] == REF_OP)
+                mark_reference(heap, (reference*)fr->local_vars[index]);
+        }
+    }
+
+    for (lc = virtual_machine->classes; lc; lc = lc->next)
+    {
+        if (!lc->static_data)
+            continue;
+
+        for (index = 0; index < lc->jc->field_count; index++)
+        {
+            field = lc->jc->fields + index;
+
+            if ((field->access_flags & STATIC_ACCESS_FLAG) && field_holds_reference(lc->jc, field))
+                mark_reference(heap, (reference*)lc->static_data[field->offset]);
+        }
+    }
+
+    for (slot = 0; slot < virtual_machine->string_table_size; slot++)
+        mark_reference(heap, virtual_machine->string_table[slot]);
+}
+
+static uint64_t get_time_microseconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// Merges dead objects and free chunks that sit next to each other into
+// chunks listed in *chunks and returns the bytes freed. *empty is set when
+// nothing in the region survived, in which case no chunk is listed.
+static uint32_t sweep_region(gc_region* region, reference** chunks, uint8_t* empty)
+{
+    uint8_t* position = REGION_START(region);
+    uint8_t* run = NULL;
+    reference* obj;
+    uint32_t freed = 0;
+    uint32_t size;
+
+    *chunks = NULL;
+
+    while (position < region->top)
+    {
+        obj = (reference*)position;
+        size = get_chunk_size(obj);
+
+        if (obj->type != REF_TYPE_FREE && obj->marked)
+        {
+            obj->marked = 0;
+
+            if (run)
+            {
+                obj = make_free_chunk(run, position - run);
+                obj->chunk.next = *chunks;
+                *chunks = obj;
+                run = NULL;
+            }
+        }
+        else
+        {
+            if (obj->type != REF_TYPE_FREE)
+                freed += size;
+
+            if (!run)
+                run = position;
+        }
+
+        position += size;
+    }
+
+    // Space never bump-allocated joins the last run when it can.
+    if (run || (uint32_t)(region->end - region->top) >= GC_MIN_CHUNK_SIZE)
+    {
+        if (!run)
+            run = region->top;
+
+        region->top = region->end;
+    }
+
+    *empty = run == REGION_START(region);
+
+    if (run && !*empty)
+    {
+        obj = make_free_chunk(run, region->end - run);
+        obj->chunk.next = *chunks;
+        *chunks = obj;
+    }
+
+    return freed;
+}
+
+static void mark_shared_reference(gc_heap* heap, gc_worker_queue* queue, reference* obj)
+{
+    if (!obj || IS_YOUNG_REFERENCE(heap, obj) || __atomic_exchange_n(&obj->marked, 1, __ATOMIC_ACQ_REL))
+        return;
+
+    if (has_references(obj) && !push_reference(&queue->local, obj))
+        __atomic_store_n(&heap->mark_overflow, 1, __ATOMIC_RELAXED);
+}
+
+static void mark_shared_fields(gc_heap* heap, gc_worker_queue* queue, reference* obj)
+{
+    uint32_t index;
+
+    if (obj->type == REF_TYPE_CLASSINSTANCE)
+    {
+        for (index = 0; index < obj->ci.c->reference_slot_count; index++)
+            mark_shared_reference(heap, queue, (reference*)*(int32_t*)(INSTANCE_FIELDS(obj) + obj->ci.c->reference_slots[index]));
+    }
+    else
+    {
+        for (index = 0; index < obj->oar.length; index++)
+            mark_shared_reference(heap, queue, OBJECT_ARRAY_ELEMENTS(obj)[index]);
+    }
+}
+
+// Moves half of the local stack (at most GC_STEAL_BATCH entries) to the
+// shared one. Called by the owner once its shared stack has been emptied.
+static void publish_references(gc_worker_queue* queue)
+{
+    uint32_t count = queue->local.count / 2;
+    uint32_t index;
+
+    if (count > GC_STEAL_BATCH)
+        count = GC_STEAL_BATCH;
+
+    pthread_mutex_lock(&queue->lock);
+
+    for (index = 0; index < count; index++)
+    {
+        if (!push_reference(&queue->shared, queue->local.entries[queue->local.count - 1]))
+            break;
+
+        queue->local.count--;
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Moves up to limit entries from the victim's shared stack to the thief's
+// local one. Only the victim's lock is held, so two threads can steal from
+// each other, and an owner takes back its own work the same way.
+static uint8_t take_shared_references(gc_heap* heap, gc_worker_queue* thief, gc_worker_queue* victim, uint32_t limit)
+{
+    reference* taken[GC_STEAL_BATCH];
+    uint32_t count, index;
+
+    if (__atomic_load_n(&victim->shared.count, __ATOMIC_RELAXED) == 0)
+        return 0;
+
+    pthread_mutex_lock(&victim->lock);
+
+    count = victim->shared.count < limit ? victim->shared.count : limit;
+
+    if (count > GC_STEAL_BATCH)
+        count = GC_STEAL_BATCH;
+
+    for (index = 0; index < count; index++)
+        taken[index] = victim->shared.entries[--victim->shared.count];
+
+    pthread_mutex_unlock(&victim->lock);
+
+    for (index = 0; index < count; index++)
+    {
+        if (!push_reference(&thief->local, taken[index]))
+            __atomic_store_n(&heap->mark_overflow, 1, __ATOMIC_RELAXED);
+    }
+
+    return count > 0;
+}
+
+// Takes the top half (at most GC_STEAL_BATCH entries) of the first non-empty
+// shared stack of another thread.
+static uint8_t steal_references(gc_workers* workers, gc_worker_queue* thief)
+{
+    gc_heap* heap = &workers->virtual_machine->heap;
+    uint32_t total = workers->thread_count + 1;
+    gc_worker_queue* victim;
+    uint32_t offset;
+
+    for (offset = 1; offset < total; offset++)
+    {
+        victim = workers->queues + (thief->index + offset) % total;
+
+        if (take_shared_references(heap, thief, victim, (__atomic_load_n(&victim->shared.count, __ATOMIC_RELAXED) + 1) / 2))
+            return 1;
+    }
+
+    return 0;
+}
+
+static uint8_t has_shared_references(gc_workers* workers)
+{
+    uint32_t index;
+
+    for (index = 0; index <= workers->thread_count; index++)
+    {
+        if (__atomic_load_n(&workers->queues[index].shared.count, __ATOMIC_RELAXED) > 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+static void mark_with_workers(gc_workers* workers, gc_worker_queue* queue)
+{
+    gc_heap* heap = &workers->virtual_machine->heap;
+    uint32_t total = workers->thread_count + 1;
+    uint32_t work = 0;
+    reference* obj;
+
+    while (!__atomic_load_n(&workers->out_of_time, __ATOMIC_RELAXED))
+    {
+        if (queue->local.count > 1 && __atomic_load_n(&workers->idle, __ATOMIC_RELAXED) > 0 &&
+            __atomic_load_n(&queue->shared.count, __ATOMIC_RELAXED) == 0)
+        {
+            publish_references(queue);
+        }
+
+        if (queue->local.count > 0 || take_shared_references(heap, queue, queue, GC_STEAL_BATCH))
+        {
+            obj = queue->local.entries[--queue->local.count];
+            mark_shared_fields(heap, queue, obj);
+
+            if (++work % GC_WORK_QUANTUM == 0 && get_time_microseconds() >= workers->deadline)
+                __atomic_store_n(&workers->out_of_time, 1, __ATOMIC_RELAXED);
+
+            continue;
+        }
+
+        if (steal_references(workers, queue))
+            continue;
+
+        // Only the owner pushes to its stacks and it never idles with a
+        // non-empty one, so once every thread is idle no gray object is left.
+        if (__atomic_add_fetch(&workers->idle, 1, __ATOMIC_ACQ_REL) == total)
+            break;
+
+        while (__atomic_load_n(&workers->idle, __ATOMIC_ACQUIRE) < total &&
+               !__atomic_load_n(&workers->out_of_time, __ATOMIC_RELAXED) && !has_shared_references(workers))
+        {
+            sched_yield();
+        }
+
+        if (__atomic_load_n(&workers->idle, __ATOMIC_ACQUIRE) == total)
+            break;
+
+        __atomic_sub_fetch(&workers->idle, 1, __ATOMIC_ACQ_REL);
+    }
+}
+
+static void sweep_with_workers(gc_workers* workers)
+{
+    gc_heap* heap = &workers->virtual_machine->heap;
+    gc_region* region;
+    reference* chunks;
+    reference* chunk;
+    uint32_t freed;
+    uint8_t empty;
+
+    while (!__atomic_load_n(&workers->out_of_time, __ATOMIC_RELAXED))
+    {
+        pthread_mutex_lock(&workers->lock);
+        region = heap->sweep_regions;
+
+        if (region)
+            heap->sweep_regions = region->next;
+
+        pthread_mutex_unlock(&workers->lock);
+
+        if (!region)
+            break;
+
+        freed = sweep_region(region, &chunks, &empty);
+
+        if (empty)
+            free(region);
+
+        pthread_mutex_lock(&workers->lock);
+
+        heap->used -= freed;
+
+        if (!empty)
+        {
+            region->next = heap->regions;
+            heap->regions = region;
+        }
+
+        while (chunks)
+        {
+            chunk = chunks;
+            chunks = chunk->chunk.next;
+            add_free_chunk(heap, chunk);
+        }
+
+        pthread_mutex_unlock(&workers->lock);
+
+        if (get_time_microseconds() >= workers->deadline)
+            __atomic_store_n(&workers->out_of_time, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void run_gc_task(gc_workers* workers, gc_worker_queue* queue)
+{
+    if (workers->task == GC_TASK_MARK)
+        mark_with_workers(workers, queue);
+    else
+        sweep_with_workers(workers);
+}
+
+static void* gc_worker(void* argument)
+{
+    gc_worker_queue* queue = (gc_worker_queue*)argument;
+    gc_workers* workers = queue->workers;
+    uint32_t generation = 0;
+
+    pthread_mutex_lock(&workers->lock);
+
+    while (1)
+    {
+        while (!workers->stopping && workers->generation == generation)
+            pthread_cond_wait(&workers->work_available, &workers->lock);
+
+        if (workers->stopping)
+            break;
+
+        generation = workers->generation;
+        pthread_mutex_unlock(&workers->lock);
+
+        run_gc_task(workers, queue);
+
+        pthread_mutex_lock(&workers->lock);
+
+        if (--workers->running == 0)
+            pthread_cond_signal(&workers->work_done);
+    }
+
+    pthread_mutex_unlock(&workers->lock);
+
+    return NULL;
+}
+
+// Runs a task on every thread and returns 1 if it finished before the deadline.
+static uint8_t share_gc_task(gc_workers* workers, uint8_t task, uint64_t deadline)
+{
+    pthread_mutex_lock(&workers->lock);
+    workers->task = task;
+    workers->deadline = deadline;
+    workers->idle = 0;
+    workers->out_of_time = 0;
+    workers->running = workers->thread_count;
+    workers->generation++;
+    pthread_cond_broadcast(&workers->work_available);
+    pthread_mutex_unlock(&workers->lock);
+
+    run_gc_task(workers, workers->queues);
+
+    pthread_mutex_lock(&workers->lock);
+
+    while (workers->running > 0)
+        pthread_cond_wait(&workers->work_done, &workers->lock);
+
+    pthread_mutex_unlock(&workers->lock);
+
+    return !workers->out_of_time;
+}
+
+static void mark_in_parallel(gc_workers* workers, uint64_t deadline)
+{
+    gc_heap* heap = &workers->virtual_machine->heap;
+    uint32_t total = workers->thread_count + 1;
+    gc_worker_queue* queue;
+    uint32_t index;
+
+    for (index = 0; index < heap->mark_stack.count; index++)
+    {
+        queue = workers->queues + index % total;
+
+        if (!push_reference(&queue->local, heap->mark_stack.entries[index]))
+            heap->mark_overflow = 1;
+    }
+
+    heap->mark_stack.count = 0;
+
+    share_gc_task(workers, GC_TASK_MARK, deadline);
+
+    // Whatever is left when time runs out waits for the next step.
+    for (index = 0; index < total; index++)
+    {
+        queue = workers->queues + index;
+
+        while (queue->local.count > 0)
+        {
+            if (!push_reference(&heap->mark_stack, queue->local.entries[--queue->local.count]))
+                heap->mark_overflow = 1;
+        }
+
+        while (queue->shared.count > 0)
+        {
+            if (!push_reference(&heap->mark_stack, queue->shared.entries[--queue->shared.count]))
+                heap->mark_overflow = 1;
+        }
+    }
+}
+
+static void stop_gc_workers(gc_workers* workers)
+{
+    uint32_t index;
+
+    pthread_mutex_lock(&workers->lock);
+    workers->stopping = 1;
+    pthread_cond_broadcast(&workers->work_available);
+    pthread_mutex_unlock(&workers->lock);
+
+    for (index = 0; index < workers->thread_count; index++)
+        pthread_join(workers->threads[index], NULL);
+
+    for (index = 0; index <= workers->thread_count; index++)
+    {
+        free(workers->queues[index].local.entries);
+        free(workers->queues[index].shared.entries);
+        pthread_mutex_destroy(&workers->queues[index].lock);
+    }
+
+    pthread_cond_destroy(&workers->work_done);
+    pthread_cond_destroy(&workers->work_available);
+    pthread_mutex_destroy(&workers->lock);
+    free(workers);
+}
+
+static gc_workers* start_gc_workers(interpreter_module* virtual_machine, uint32_t thread_count)
+{
+    gc_workers* workers = (gc_workers*)malloc(sizeof(gc_workers));
+    uint32_t index;
+
+    if (!workers)
+        return NULL;
+
+    workers->virtual_machine = virtual_machine;
+    workers->thread_count = 0;
+    workers->generation = 0;
+    workers->running = 0;
+    workers->stopping = 0;
+
+    pthread_mutex_init(&workers->lock, NULL);
+    pthread_cond_init(&workers->work_available, NULL);
+    pthread_cond_init(&workers->work_done, NULL);
+
+    for (index = 0; index < thread_count; index++)
+    {
+        workers->queues[index].workers = workers;
+        workers->queues[index].index = index;
+        workers->queues[index].local.entries = workers->queues[index].shared.entries = NULL;
+        workers->queues[index].local.count = workers->queues[index].local.capacity = 0;
+        workers->queues[index].shared.count = workers->queues[index].shared.capacity = 0;
+        pthread_mutex_init(&workers->queues[index].lock, NULL);
+    }
+
+    // Helper thread i works from queue i + 1.
+    for (index = 0; index + 1 < thread_count; index++)
+    {
+        if (pthread_create(workers->threads + index, NULL, gc_worker, workers->queues + index + 1) != 0)
+            break;
+
+        workers->thread_count++;
+    }
+
+    for (index = workers->thread_count + 1; index < thread_count; index++)
+        pthread_mutex_destroy(&workers->queues[index].lock);
+
+    if (workers->thread_count == 0)
+    {
+        stop_gc_workers(workers);
+        return NULL;
+    }
+
+    return workers;
+}
+
+uint32_t get_default_gc_thread_count(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (cores > 1)
+        return cores < 8 ? (uint32_t)cores : 8;
+#endif
+
+    return 1;
+}
+
+void set_gc_threads(interpreter_module* virtual_machine, uint32_t thread_count)
+{
+    gc_heap* heap = &virtual_machine->heap;
+
+    if (thread_count > GC_MAX_THREADS)
+        thread_count = GC_MAX_THREADS;
+
+    if (heap->workers)
+    {
+        stop_gc_workers(heap->workers);
+        heap->workers = NULL;
+    }
+
+    if (thread_count > 1)
+        heap->workers = start_gc_workers(virtual_machine, thread_count);
+}
+
+// Returns 1 once no gray object is left.
+static uint8_t mark_step(interpreter_module* virtual_machine, uint64_t deadline)
+{
+    gc_heap* heap = &virtual_machine->heap;
+    gc_region* region;
+    reference* obj;
+    uint32_t work = 0;
+
+    while (heap->mark_stack.count > 0 || heap->mark_overflow)
+    {
+        if (heap->workers && heap->mark_stack.count >= GC_PARALLEL_MARK_MIN)
+        {
+            mark_in_parallel(heap->workers, deadline);
+
+            if (get_time_microseconds() >= deadline)
+                return 0;
+
+            continue;
+        }
+
+        if (heap->mark_stack.count == 0)
+        {
+            heap->mark_overflow = 0;
+
+            for (region = heap->regions; region; region = region->next)
+            {
+                for (obj = next_old_object(region, NULL); obj; obj = next_old_object(region, obj))
+                {
+                    if (obj->marked)
+                        mark_fields(heap, obj);
+                }
+            }
+
+            continue;
+        }
+
+        mark_fields(heap, heap->mark_stack.entries[--heap->mark_stack.count]);
+
+        if (++work % GC_WORK_QUANTUM == 0 && get_time_microseconds() >= deadline)
+            return 0;
+    }
+
+    return 1;
+}
+
+// Returns 1 once every region that was in the old generation when marking
+// finished has been swept.
+static uint8_t sweep_step(interpreter_module* virtual_machine, uint64_t deadline)
+{
+    gc_heap* heap = &virtual_machine->heap;
+    gc_region* region;
+    reference* chunks;
+    reference* chunk;
+    uint8_t empty;
+
+    if (heap->workers)
+        return share_gc_task(heap->workers, GC_TASK_SWEEP, deadline) && !heap->sweep_regions;
+
+    while (heap->sweep_regions)
+    {
+        region = heap->sweep_regions;
+        heap->sweep_regions = region->next;
+        heap->used -= sweep_region(region, &chunks, &empty);
+
+        if (empty)
+        {
+            free(region);
+        }
+        else
+        {
+            region->next = heap->regions;
+            heap->regions = region;
+        }
+
+        while (chunks)
+        {
+            chunk = chunks;
+            chunks = chunk->chunk.next;
+            add_free_chunk(heap, chunk);
+        }
+
+        if (get_time_microseconds() >= deadline)
+            return heap->sweep_regions == NULL;
+    }
+
+    return 1;
+}
+
+static void record_pause(gc_heap* heap, uint32_t duration)
+{
+    uint32_t bucket = 0;
+
+    while (bucket < GC_PAUSE_BUCKETS - 1 && (duration >> bucket) != 0)
+        bucket++;
+
+    heap->pause_counts[bucket]++;
+    heap->pause_total += duration;
+
+    if (duration > heap->pause_max)
+        heap->pause_max = duration;
+}
+
+uint8_t collect_garbage(interpreter_module* virtual_machine)
+{
+    gc_heap* heap = &virtual_machine->heap;
+    uint64_t start = get_time_microseconds();
+    uint64_t deadline = start + heap->pause_target;
+    uint8_t success = 1;
+
+    heap->collect_requested = 0;
+    heap->step_allocated = 0;
+
+    // A cycle starts with an empty nursery, so its snapshot holds old objects only.
+    if (heap->nursery_full || (heap->phase == GC_IDLE && heap->used >= heap->threshold))
+        success = collect_nursery(virtual_machine);
+
+    // Out of room: finish the cycle in this pause rather than keep allocating.
+    if (heap->used > heap->size)
+        deadline = UINT64_MAX;
+
+    if (success && heap->phase == GC_IDLE && heap->used >= heap->threshold)
+    {
+        heap->phase = GC_MARKING;
+        mark_roots(virtual_machine);
+    }
+
+    if (success && heap->phase == GC_MARKING && mark_step(virtual_machine, deadline))
+    {
+        heap->phase = GC_SWEEPING;
+        heap->sweep_regions = heap->regions;
+        heap->regions = NULL;
+
+        // Free chunks are rebuilt by the sweep. Until then, allocation only
+        // uses regions added after it started.
+        heap->allocation_region = NULL;
+        memset(heap->free_lists, 0, sizeof(heap->free_lists));
+    }
+
+    if (success && heap->phase == GC_SWEEPING && sweep_step(virtual_machine, deadline))
+    {
+        heap->phase = GC_IDLE;
+
+        // Let the old generation grow to twice the live data before collecting again.
+        if (heap->used > heap->size / 2)
+            heap->threshold = heap->size;
+        else if (heap->used * 2 > GC_MIN_THRESHOLD)
+            heap->threshold = heap->used * 2;
+        else
+            heap->threshold = GC_MIN_THRESHOLD < heap->size ? GC_MIN_THRESHOLD : heap->size;
+    }
+
+    record_pause(heap, (uint32_t)(get_time_microseconds() - start));
+
+    if (!success || (heap->phase == GC_IDLE && heap->used > heap->size))
+    {
+        virtual_machine->status = OUT_OF_MEMORY;
+        return 0;
+    }
+
+    return 1;
+}
+
+void print_gc_pauses(interpreter_module* virtual_machine)
+{
+    gc_heap* heap = &virtual_machine->heap;
+    uint32_t count = 0;
+    uint32_t seen = 0;
+    uint32_t bucket;
+
+    for (bucket = 0; bucket < GC_PAUSE_BUCKETS; bucket++)
+        count += heap->pause_counts[bucket];
+
+    printf("GC pauses: %u, total %llu us, longest %u us\n", count, (unsigned long long)heap->pause_total, heap->pause_max);
+
+    for (bucket = 0; bucket < GC_PAUSE_BUCKETS; bucket++)
+    {
+        if (heap->pause_counts[bucket] == 0)
+            continue;
+
+        seen += heap->pause_counts[bucket];
+
+        if (bucket == GC_PAUSE_BUCKETS - 1)
+            printf("  >= %8u us: %u", 1u << (bucket - 1), heap->pause_counts[bucket]);
+        else
+            printf("  <  %8u us: %u", 1u << bucket, heap->pause_counts[bucket]);
+
+        // Marks the bucket that holds the 99th percentile pause.
+        if (seen * 100 >= count * 99 && (seen - heap->pause_counts[bucket]) * 100 < count * 99)
+            printf(" (p99)");
+
+        printf("\n");
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef GC_H
+#define GC_H
+
+#include <stdint.h>
+#include "jvm.h"
+
+#define GC_DEFAULT_HEAP_SIZE (64 * 1024 * 1024)
+#define GC_MIN_THRESHOLD (1024 * 1024)
+#define GC_MAX_NURSERY_SIZE (2 * 1024 * 1024)
+#define GC_DEFAULT_PAUSE_TARGET 5
+#define GC_MAX_THREADS 16
+
+// Largest payload whose object size still fits in 32 bits once aligned.
+#define GC_MAX_PAYLOAD_SIZE (UINT32_MAX - (uint32_t)sizeof(reference) - 7)
+#define GC_MAX_ARRAY_LENGTH(element_size, extra) ((GC_MAX_PAYLOAD_SIZE - (uint32_t)(extra)) / (uint32_t)(element_size))
+
+#define IS_YOUNG_REFERENCE(heap, obj) \
+    ((uint8_t*)(obj) >= (heap)->nursery && (uint8_t*)(obj) < (heap)->nursery_end)
+
+uint8_t build_reference_slots(java_class*, java_class*);
+uint32_t get_reference_size(reference*);
+reference* allocate_reference(interpreter_module*, reference_type, uint32_t);
+reference* allocate_tenured_reference(interpreter_module*, reference_type, uint32_t);
+void remember_reference_store(interpreter_module*, reference*, reference*, reference*);
+void remember_static_store(interpreter_module*, loaded_classes*, reference*);
+void set_heap_size(interpreter_module*, uint32_t);
+void set_pause_target(interpreter_module*, uint32_t);
+void set_gc_threads(interpreter_module*, uint32_t);
+uint32_t get_default_gc_thread_count(void);
+void print_gc_pauses(interpreter_module*);
+void release_heap(interpreter_module*);
+uint8_t collect_garbage(interpreter_module*);
+
+#endif
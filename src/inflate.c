@@ -0,0 +1,362 @@
+#include <string.h>
+#include "inflate.h"
+
+typedef struct inflate_state
+{
+    const uint8_t* src;
+    uint32_t src_length;
+    uint32_t src_position;
+    uint32_t bit_buffer;
+    uint8_t bit_count;
+    uint8_t* dst;
+    uint32_t dst_length;
+    uint32_t dst_position;
+} inflate_state;
+
+typedef struct huffman_table
+{
+    uint16_t counts[16];
+    uint16_t symbols[288];
+} huffman_table;
+
+static const uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const uint8_t length_extra_bits[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static const uint16_t distance_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+
+static const uint8_t distance_extra_bits[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static const uint8_t code_length_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+static int32_t read_bits(inflate_state* state, uint8_t count)
+{
+    int32_t value;
+
+    while (state->bit_count < count)
+    {
+        if (state->src_position >= state->src_length)
+            return -1;
+
+        state->bit_buffer |= (uint32_t)state->src[state->src_position++] << state->bit_count;
+        state->bit_count += 8;
+    }
+
+    value = (int32_t)(state->bit_buffer & ((1UL << count) - 1));
+    state->bit_buffer >>= count;
+    state->bit_count -= count;
+
+    return value;
+}
+
+static uint8_t build_huffman_table(huffman_table* table, const uint8_t* lengths, uint16_t count)
+{
+    uint16_t offsets[16];
+    int32_t left = 1;
+    uint16_t index;
+
+    memset(table->counts, 0, sizeof(table->counts));
+
+    for (index = 0; index < count; index++)
+        table->counts[lengths[index]]++;
+
+    table->counts[0] = 0;
+
+    for (index = 1; index < 16; index++)
+    {
+        left = (left << 1) - table->counts[index];
+
+        if (left < 0)
+            return 0;
+    }
+
+    offsets[1] = 0;
+
+    for (index = 1; index < 15; index++)
+        offsets[index + 1] = offsets[index] + table->counts[index];
+
+    for (index = 0; index < count; index++)
+    {
+        if (lengths[index])
+            table->symbols[offsets[lengths[index]]++] = index;
+    }
+
+    return 1;
+}
+
+static int32_t decode_symbol(inflate_state* state, const huffman_table* table)
+{
+    int32_t code = 0, first = 0, index = 0, bit;
+    uint8_t length;
+
+    for (length = 1; length < 16; length++)
+    {
+        bit = read_bits(state, 1);
+
+        if (bit < 0)
+            return -1;
+
+        code |= bit;
+
+        if (code - first < table->counts[length])
+            return table->symbols[index + code - first];
+
+        index += table->counts[length];
+        first = (first + table->counts[length]) << 1;
+        code <<= 1;
+    }
+
+    return -1;
+}
+
+static uint8_t inflate_stored_block(inflate_state* state)
+{
+    uint16_t length, inverted_length;
+
+    state->bit_buffer = 0;
+    state->bit_count = 0;
+
+    if (state->src_length - state->src_position < 4)
+        return 0;
+
+    length = state->src[state->src_position] | (state->src[state->src_position + 1] << 8);
+    inverted_length = state->src[state->src_position + 2] | (state->src[state->src_position + 3] << 8);
+    state->src_position += 4;
+
+    if (length != (uint16_t)~inverted_length ||
+        state->src_length - state->src_position < length ||
+        state->dst_length - state->dst_position < length)
+    {
+        return 0;
+    }
+
+    memcpy(state->dst + state->dst_position, state->src + state->src_position, length);
+    state->src_position += length;
+    state->dst_position += length;
+
+    return 1;
+}
+
+static uint8_t inflate_compressed_block(inflate_state* state, const huffman_table* literals, const huffman_table* distances)
+{
+    int32_t symbol, extra;
+    uint32_t length, distance;
+
+    while (1)
+    {
+        symbol = decode_symbol(state, literals);
+
+        if (symbol < 0)
+            return 0;
+
+        if (symbol < 256)
+        {
+            if (state->dst_position >= state->dst_length)
+                return 0;
+
+            state->dst[state->dst_position++] = (uint8_t)symbol;
+            continue;
+        }
+
+        if (symbol == 256)
+            return 1;
+
+        symbol -= 257;
+
+        if (symbol >= 29 || (extra = read_bits(state, length_extra_bits[symbol])) < 0)
+            return 0;
+
+        length = length_base[symbol] + extra;
+        symbol = decode_symbol(state, distances);
+
+        if (symbol < 0 || symbol >= 30 || (extra = read_bits(state, distance_extra_bits[symbol])) < 0)
+            return 0;
+
+        distance = distance_base[symbol] + extra;
+
+        if (distance > state->dst_position || state->dst_length - state->dst_position < length)
+            return 0;
+
+        while (length--)
+        {
+            state->dst[state->dst_position] = state->dst[state->dst_position - distance];
+            state->dst_position++;
+        }
+    }
+}
+
+static uint8_t inflate_fixed_block(inflate_state* state)
+{
+    huffman_table literals, distances;
+    uint8_t lengths[288];
+    uint16_t index;
+
+    for (index = 0; index < 144; index++)
+        lengths[index] = 8;
+
+    for (; index < 256; index++)
+        lengths[index] = 9;
+
+    for (; index < 280; index++)
+        lengths[index] = 7;
+
+    for (; index < 288; index++)
+        lengths[index] = 8;
+
+    build_huffman_table(&literals, lengths, 288);
+
+    for (index = 0; index < 30; index++)
+        lengths[index] = 5;
+
+    build_huffman_table(&distances, lengths, 30);
+
+    return inflate_compressed_block(state, &literals, &distances);
+}
+
+static uint8_t inflate_dynamic_block(inflate_state* state)
+{
+    huffman_table literals, distances;
+    uint8_t lengths[320];
+    int32_t literal_count, distance_count, code_length_count;
+    int32_t symbol, repeat;
+    uint16_t index;
+    uint8_t value;
+
+    literal_count = read_bits(state, 5);
+    distance_count = read_bits(state, 5);
+    code_length_count = read_bits(state, 4);
+
+    if (literal_count < 0 || distance_count < 0 || code_length_count < 0)
+        return 0;
+
+    literal_count += 257;
+    distance_count += 1;
+    code_length_count += 4;
+
+    if (literal_count > 286 || distance_count > 30)
+        return 0;
+
+    memset(lengths, 0, 19);
+
+    for (index = 0; index < code_length_count; index++)
+    {
+        symbol = read_bits(state, 3);
+
+        if (symbol < 0)
+            return 0;
+
+        lengths[code_length_order[index]] = (uint8_t)symbol;
+    }
+
+    if (!build_huffman_table(&literals, lengths, 19))
+        return 0;
+
+    index = 0;
+
+    while (index < literal_count + distance_count)
+    {
+        symbol = decode_symbol(state, &literals);
+
+        if (symbol < 0)
+            return 0;
+
+        if (symbol < 16)
+        {
+            lengths[index++] = (uint8_t)symbol;
+            continue;
+        }
+
+        if (symbol == 16)
+        {
+            if (index == 0 || (repeat = read_bits(state, 2)) < 0)
+                return 0;
+
+            value = lengths[index - 1];
+            repeat += 3;
+        }
+        else if (symbol == 17)
+        {
+            if ((repeat = read_bits(state, 3)) < 0)
+                return 0;
+
+            value = 0;
+            repeat += 3;
+        }
+        else
+        {
+            if ((repeat = read_bits(state, 7)) < 0)
+                return 0;
+
+            value = 0;
+            repeat += 11;
+        }
+
+        if (index + repeat > literal_count + distance_count)
+            return 0;
+
+        while (repeat--)
+            lengths[index++] = value;
+    }
+
+    if (lengths[256] == 0 ||
+        !build_huffman_table(&literals, lengths, literal_count) ||
+        !build_huffman_table(&distances, lengths + literal_count, distance_count))
+    {
+        return 0;
+    }
+
+    return inflate_compressed_block(state, &literals, &distances);
+}
+
+uint8_t inflate_data(const uint8_t* src, uint32_t src_length, uint8_t* dst, uint32_t dst_length)
+{
+    inflate_state state;
+    int32_t final_block, block_type;
+    uint8_t success;
+
+    state.src = src;
+    state.src_length = src_length;
+    state.src_position = 0;
+    state.bit_buffer = 0;
+    state.bit_count = 0;
+    state.dst = dst;
+    state.dst_length = dst_length;
+    state.dst_position = 0;
+
+    do
+    {
+        final_block = read_bits(&state, 1);
+        block_type = read_bits(&state, 2);
+
+        if (final_block < 0 || block_type < 0)
+            return 0;
+
+        switch (block_type)
+        {
+            case 0: success = inflate_stored_block(&state); break;
+            case 1: success = inflate_fixed_block(&state); break;
+            case 2: success = inflate_dynamic_block(&state); break;
+            default: success = 0; break;
+        }
+
+        if (!success)
+            return 0;
+
+    } while (!final_block);
+
+    return state.dst_position == dst_length;
+}
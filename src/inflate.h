@@ -0,0 +1,8 @@
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <stdint.h>
+
+uint8_t inflate_data(const uint8_t*, uint32_t, uint8_t*, uint32_t);
+
+#endif
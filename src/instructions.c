@@ -2,12 +2,55 @@
 #include "utf8.h"
 #include "jvm.h"
 #include "natives.h"
+#include "gc.h"
 #include <math.h>
 
 #define NEXT_BYTE (*(fr->bytecode + fr->PC++))
 #define HIWORD(x) ((int32_t)(x >> 32))
 #define LOWORD(x) ((int32_t)(x & 0xFFFFFFFFll))
 
+// Rewrites the opcode of the instruction that just ran, whose operands end at
+// the current PC, so that later executions dispatch to its quick form.
+#define QUICKEN_INSTRUCTION(length, quick_opcode) (fr->bytecode[fr->PC - (length)] = (quick_opcode))
+
+uint8_t instfunc_getstatic_quick(interpreter_module*, frame*);
+uint8_t instfunc_putstatic_quick(interpreter_module*, frame*);
+uint8_t instfunc_getfield_quick(interpreter_module*, frame*);
+uint8_t instfunc_putfield_quick(interpreter_module*, frame*);
+uint8_t instfunc_invokevirtual_quick(interpreter_module*, frame*);
+uint8_t instfunc_invokespecial_quick(interpreter_module*, frame*);
+uint8_t instfunc_invokestatic_quick(interpreter_module*, frame*);
+uint8_t instfunc_invokeinterface_quick(interpreter_module*, frame*);
+uint8_t instfunc_new_quick(interpreter_module*, frame*);
+
+static uint8_t get_field_operand_type(uint8_t descriptor, operand_type* type)
+{
+    switch (descriptor)
+    {
+        case 'J': *type = LONG_OP; break;
+        case 'D': *type = DOUBLE_OP; break;
+        case 'F': *type = FLOAT_OP; break;
+
+        case 'L':
+        case '[':
+            *type = REF_OP;
+            break;
+
+        case 'B':
+        case 'C':
+        case 'I':
+        case 'S':
+        case 'Z':
+            *type = INT_OP;
+            break;
+
+        default:
+            return 0;
+    }
+
+    return 1;
+}
+
 uint8_t instfunc_nop(interpreter_module* jvm, frame* fr)
 {
     return 1;
@@ -114,14 +157,19 @@ uint8_t instfunc_ldc(interpreter_module* jvm, frame* fr)
 
         case STRING_CONST:
         {
-            cpi = fr->jc->constant_pool + cpi->String.string_index - 1;
-
-            reference* str = create_new_string(jvm, UTF8(cpi));
+            reference* str = cpi->String.resolved_string;
 
             if (!str)
             {
-                jvm->status = OUT_OF_MEMORY;
-                return 0;
+                str = intern_string(jvm, fr->jc->constant_pool[cpi->String.string_index - 1].Utf8.sym);
+
+                if (!str)
+                {
+                    jvm->status = OUT_OF_MEMORY;
+                    return 0;
+                }
+
+                cpi->String.resolved_string = str;
             }
 
             value = (int32_t)str;
@@ -196,14 +244,19 @@ uint8_t instfunc_ldc_w(interpreter_module* jvm, frame* fr)
 
         case STRING_CONST:
         {
-            cpi = fr->jc->constant_pool + cpi->String.string_index - 1;
-
-            reference* str = create_new_string(jvm, UTF8(cpi));
+            reference* str = cpi->String.resolved_string;
 
             if (!str)
             {
-                jvm->status = OUT_OF_MEMORY;
-                return 0;
+                str = intern_string(jvm, fr->jc->constant_pool[cpi->String.string_index - 1].Utf8.sym);
+
+                if (!str)
+                {
+                    jvm->status = OUT_OF_MEMORY;
+                    return 0;
+                }
+
+                cpi->String.resolved_string = str;
             }
 
             value = (int32_t)str;
@@ -425,7 +478,7 @@ DECLR_CAT_1_LOAD_N_FAMILY(aload, 3, REF_OP)
             DEBUG_REPORT_ERROR_INSTRUCTION \
             return 0; \
         } \
-        type* ptr = (type*)obj->arr.data; \
+        type* ptr = (type*)ARRAY_ELEMENTS(obj); \
         if (!push_to_stack_operand(&fr->operands, ptr[index], op_type)) \
         { \
             jvm->status = OUT_OF_MEMORY; \
@@ -455,7 +508,7 @@ DECLR_CAT_1_LOAD_N_FAMILY(aload, 3, REF_OP)
             DEBUG_REPORT_ERROR_INSTRUCTION \
             return 0; \
         } \
-        type* ptr = (type*)obj->arr.data; \
+        type* ptr = (type*)ARRAY_ELEMENTS(obj); \
         if (!push_to_stack_operand(&fr->operands, HIWORD(ptr[index]), op_type) || \
             !push_to_stack_operand(&fr->operands, LOWORD(ptr[index]), op_type)) \
         { \
@@ -496,7 +549,7 @@ uint8_t instfunc_aaload(interpreter_module* jvm, frame* fr)
         return 0;
     }
 
-    reference** ptr = (reference**)obj->oar.elements;
+    reference** ptr = OBJECT_ARRAY_ELEMENTS(obj);
 
     if (!push_to_stack_operand(&fr->operands, (int32_t)ptr[index], REF_OP))
     {
@@ -510,9 +563,12 @@ uint8_t instfunc_aaload(interpreter_module* jvm, frame* fr)
 #define DECLR_STORE_CAT_1_FAMILY(instructionprefix) \
     uint8_t instfunc_##instructionprefix(interpreter_module* jvm, frame* fr) \
     { \
+        uint8_t index = NEXT_BYTE; \
         int32_t operand; \
-        pop_from_stack_operand(&fr->operands, &operand, NULL); \
-        *(fr->local_vars + NEXT_BYTE) = operand; \
+        operand_type type; \
+        pop_from_stack_operand(&fr->operands, &operand, &type); \
+        *(fr->local_vars + index) = operand; \
+        fr->local_types[index] = type; \
         return 1; \
     }
 
@@ -522,8 +578,10 @@ uint8_t instfunc_aaload(interpreter_module* jvm, frame* fr)
         uint16_t index = NEXT_BYTE; \
         index = (index << 8) | NEXT_BYTE; \
         int32_t operand; \
-        pop_from_stack_operand(&fr->operands, &operand, NULL); \
+        operand_type type; \
+        pop_from_stack_operand(&fr->operands, &operand, &type); \
         *(fr->local_vars + index) = operand; \
+        fr->local_types[index] = type; \
         return 1; \
     }
 
@@ -533,10 +591,12 @@ uint8_t instfunc_aaload(interpreter_module* jvm, frame* fr)
         uint8_t index = NEXT_BYTE; \
         int32_t highoperand; \
         int32_t lowoperand; \
-        pop_from_stack_operand(&fr->operands, &lowoperand, NULL); \
+        operand_type type; \
+        pop_from_stack_operand(&fr->operands, &lowoperand, &type); \
         pop_from_stack_operand(&fr->operands, &highoperand, NULL); \
         *(fr->local_vars + index) = highoperand; \
         *(fr->local_vars + index + 1) = lowoperand; \
+        fr->local_types[index] = fr->local_types[index + 1] = type; \
         return 1; \
     }
 
@@ -547,10 +607,12 @@ uint8_t instfunc_aaload(interpreter_module* jvm, frame* fr)
         index = (index << 8) | NEXT_BYTE; \
         int32_t highoperand; \
         int32_t lowoperand; \
-        pop_from_stack_operand(&fr->operands, &lowoperand, NULL); \
+        operand_type type; \
+        pop_from_stack_operand(&fr->operands, &lowoperand, &type); \
         pop_from_stack_operand(&fr->operands, &highoperand, NULL); \
         *(fr->local_vars + index) = highoperand; \
         *(fr->local_vars + index + 1) = lowoperand; \
+        fr->local_types[index] = fr->local_types[index + 1] = type; \
         return 1; \
     }
 
@@ -570,8 +632,10 @@ DECLR_WIDE_STORE_CAT_1_FAMILY(astore)
     uint8_t instfunc_##instructionprefix##_##N(interpreter_module* jvm, frame* fr) \
     { \
         int32_t operand; \
-        pop_from_stack_operand(&fr->operands, &operand, NULL); \
+        operand_type type; \
+        pop_from_stack_operand(&fr->operands, &operand, &type); \
         *(fr->local_vars + N) = operand; \
+        fr->local_types[N] = type; \
         return 1; \
     }
 
@@ -580,10 +644,12 @@ DECLR_WIDE_STORE_CAT_1_FAMILY(astore)
     { \
         int32_t highoperand; \
         int32_t lowoperand; \
-        pop_from_stack_operand(&fr->operands, &lowoperand, NULL); \
+        operand_type type; \
+        pop_from_stack_operand(&fr->operands, &lowoperand, &type); \
         pop_from_stack_operand(&fr->operands, &highoperand, NULL); \
         *(fr->local_vars + N) = highoperand; \
         *(fr->local_vars + N + 1) = lowoperand; \
+        fr->local_types[N] = fr->local_types[N + 1] = type; \
         return 1; \
     }
 
@@ -635,7 +701,7 @@ DECLR_STORE_N_CAT_1_FAMILY(astore, 3)
             DEBUG_REPORT_ERROR_INSTRUCTION \
             return 0; \
         } \
-        type* ptr = (type*)obj->arr.data; \
+        type* ptr = (type*)ARRAY_ELEMENTS(obj); \
         ptr[index] = (type)operand; \
         return 1; \
     }
@@ -671,7 +737,7 @@ DECLR_ASTORE_CAT_1_FAMILY(fastore, int32_t)
             DEBUG_REPORT_ERROR_INSTRUCTION \
             return 0; \
         } \
-        int64_t* ptr = (int64_t*)obj->arr.data; \
+        int64_t* ptr = (int64_t*)ARRAY_ELEMENTS(obj); \
         ptr[index] = ((int64_t)highoperand << 32) | (uint32_t)lowoperand; \
         return 1; \
     }
@@ -707,7 +773,8 @@ uint8_t instfunc_aastore(interpreter_module* jvm, frame* fr)
         return 0;
     }
 
-    arrayobj->oar.elements[index] = element;
+    remember_reference_store(jvm, arrayobj, OBJECT_ARRAY_ELEMENTS(arrayobj)[index], element);
+    OBJECT_ARRAY_ELEMENTS(arrayobj)[index] = element;
     return 1;
 }
 
@@ -1919,7 +1986,7 @@ uint8_t instfunc_getstatic(interpreter_module* jvm, frame* fr)
         cpi1 = fr->jc->constant_pool + field->Fieldref.class_index - 1;
         cpi1 = fr->jc->constant_pool + cpi1->Class.name_index - 1;
 
-        if (compare_utf8(UTF8(cpi1), (const uint8_t*)"java/lang/System", 16))
+        if (cpi1->Utf8.sym == jvm->system_class_symbol)
         {
             if (!push_to_stack_operand(&fr->operands, 0, NULL_OP))
             {
@@ -1944,41 +2011,38 @@ uint8_t instfunc_getstatic(interpreter_module* jvm, frame* fr)
     cpi1 = fr->jc->constant_pool + cpi2->NameAndType.name_index - 1;
     cpi2 = fr->jc->constant_pool + cpi2->NameAndType.descriptor_index - 1;
 
-    field_info* fi = get_maching_field(fieldLoadedClass->jc, UTF8(cpi1), UTF8(cpi2), 0);
+    field_info* fi = get_field_by_name_and_type(fieldLoadedClass->jc, cpi1, cpi2, 0);
+    operand_type type;
 
-    if (!fi)
+    if (!fi || !get_field_operand_type(*cpi2->Utf8.bytes, &type))
     {
         DEBUG_REPORT_ERROR_INSTRUCTION
         return 0;
     }
 
-    operand_type type;
+    field->Fieldref.resolved_field = fi;
 
-    switch (*cpi2->Utf8.bytes)
-    {
-        case 'J': type = LONG_OP; break;
-        case 'D': type = DOUBLE_OP; break;
-        case 'F': type = FLOAT_OP; break;
+    if (fieldLoadedClass->init_state == CLASS_INITIALIZED)
+        QUICKEN_INSTRUCTION(3, opcode_getstatic_quick);
 
-        case 'L':
-        case '[':
-            type = REF_OP;
-            break;
+    fr->PC -= 2;
+    return instfunc_getstatic_quick(jvm, fr);
+}
 
-        case 'B':
-        case 'C':
-        case 'I':
-        case 'S':
-        case 'Z':
-            type = INT_OP;
-            break;
+uint8_t instfunc_getstatic_quick(interpreter_module* jvm, frame* fr)
+{
+    uint16_t index = NEXT_BYTE;
+    index = (index << 8) | NEXT_BYTE;
 
-        default:
-            DEBUG_REPORT_ERROR_INSTRUCTION
-            return 0;
-    }
+    constant_pool_info* field = fr->jc->constant_pool + index - 1;
+    constant_pool_info* cpi = fr->jc->constant_pool + field->Fieldref.name_and_type_index - 1;
+    int32_t* data = field->Fieldref.resolved_class->static_data + field->Fieldref.resolved_field->offset;
+    operand_type type;
+
+    cpi = fr->jc->constant_pool + cpi->NameAndType.descriptor_index - 1;
+    get_field_operand_type(*cpi->Utf8.bytes, &type);
 
-    if (!push_to_stack_operand(&fr->operands, fieldLoadedClass->static_data[fi->offset], type))
+    if (!push_to_stack_operand(&fr->operands, data[0], type))
     {
         jvm->status = OUT_OF_MEMORY;
         return 0;
@@ -1986,7 +2050,7 @@ uint8_t instfunc_getstatic(interpreter_module* jvm, frame* fr)
 
     if (type == LONG_OP || type == DOUBLE_OP)
     {
-        if (!push_to_stack_operand(&fr->operands, fieldLoadedClass->static_data[fi->offset + 1], type))
+        if (!push_to_stack_operand(&fr->operands, data[1], type))
         {
             jvm->status = OUT_OF_MEMORY;
             return 0;
@@ -2017,56 +2081,51 @@ uint8_t instfunc_putstatic(interpreter_module* jvm, frame* fr)
     cpi1 = fr->jc->constant_pool + cpi2->NameAndType.name_index - 1;
     cpi2 = fr->jc->constant_pool + cpi2->NameAndType.descriptor_index - 1;
 
-    field_info* fi = get_maching_field(fieldLoadedClass->jc, UTF8(cpi1), UTF8(cpi2), 0);
+    field_info* fi = get_field_by_name_and_type(fieldLoadedClass->jc, cpi1, cpi2, 0);
+    operand_type type;
 
-    if (!fi)
+    if (!fi || !get_field_operand_type(*cpi2->Utf8.bytes, &type))
     {
         DEBUG_REPORT_ERROR_INSTRUCTION
         return 0;
     }
 
-    operand_type type;
+    field->Fieldref.resolved_field = fi;
 
-    switch (*cpi2->Utf8.bytes)
-    {
-        case 'J': type = LONG_OP; break;
-        case 'D': type = DOUBLE_OP; break;
-        case 'F': type = FLOAT_OP; break;
+    if (fieldLoadedClass->init_state == CLASS_INITIALIZED)
+        QUICKEN_INSTRUCTION(3, opcode_putstatic_quick);
 
-        case 'L':
-        case '[':
-            type = REF_OP;
-            break;
-
-        case 'B':
-        case 'C':
-        case 'I':
-        case 'S':
-        case 'Z':
-            type = INT_OP;
-            break;
+    fr->PC -= 2;
+    return instfunc_putstatic_quick(jvm, fr);
+}
 
-        default:
-            
-            DEBUG_REPORT_ERROR_INSTRUCTION
-            return 0;
-    }
+uint8_t instfunc_putstatic_quick(interpreter_module* jvm, frame* fr)
+{
+    uint16_t index = NEXT_BYTE;
+    index = (index << 8) | NEXT_BYTE;
 
+    constant_pool_info* field = fr->jc->constant_pool + index - 1;
+    constant_pool_info* cpi = fr->jc->constant_pool + field->Fieldref.name_and_type_index - 1;
+    int32_t* data = field->Fieldref.resolved_class->static_data + field->Fieldref.resolved_field->offset;
     int32_t operand;
+    operand_type type;
+
+    cpi = fr->jc->constant_pool + cpi->NameAndType.descriptor_index - 1;
+    get_field_operand_type(*cpi->Utf8.bytes, &type);
 
     pop_from_stack_operand(&fr->operands, &operand, NULL);
 
     if (type == LONG_OP || type == DOUBLE_OP)
     {
-        fieldLoadedClass->static_data[fi->offset + 1] = operand;
+        data[1] = operand;
         pop_from_stack_operand(&fr->operands, &operand, NULL);
-        fieldLoadedClass->static_data[fi->offset] = operand;
-    }
-    else
-    {
-        fieldLoadedClass->static_data[fi->offset] = operand;
     }
 
+    data[0] = operand;
+
+    if (type == REF_OP)
+        remember_static_store(jvm, field->Fieldref.resolved_class, (reference*)operand);
+
     return 1;
 }
 
@@ -2091,7 +2150,7 @@ uint8_t instfunc_getfield(interpreter_module* jvm, frame* fr)
     cpi1 = fr->jc->constant_pool + cpi2->NameAndType.name_index - 1;
     cpi2 = fr->jc->constant_pool + cpi2->NameAndType.descriptor_index - 1;
 
-    field_info* fi = get_maching_field(fieldLoadedClass->jc, UTF8(cpi1), UTF8(cpi2), 0);
+    field_info* fi = get_field_by_name_and_type(fieldLoadedClass->jc, cpi1, cpi2, 0);
 
     if (!fi)
     {
@@ -2099,7 +2158,7 @@ uint8_t instfunc_getfield(interpreter_module* jvm, frame* fr)
 
         while (super)
         {
-            fi = get_maching_field(super, UTF8(cpi1), UTF8(cpi2), 0);
+            fi = get_field_by_name_and_type(super, cpi1, cpi2, 0);
 
             if (fi)
                 break;
@@ -2108,37 +2167,34 @@ uint8_t instfunc_getfield(interpreter_module* jvm, frame* fr)
         }
     }
 
-    if (!fi)
+    operand_type type;
+
+    if (!fi || !get_field_operand_type(*cpi2->Utf8.bytes, &type))
     {
         DEBUG_REPORT_ERROR_INSTRUCTION
         return 0;
     }
 
-    operand_type type;
+    field->Fieldref.resolved_field = fi;
 
-    switch (*cpi2->Utf8.bytes)
-    {
-        case 'J': type = LONG_OP; break;
-        case 'D': type = DOUBLE_OP; break;
-        case 'F': type = FLOAT_OP; break;
+    if (fieldLoadedClass->init_state == CLASS_INITIALIZED)
+        QUICKEN_INSTRUCTION(3, opcode_getfield_quick);
 
-        case 'L':
-        case '[':
-            type = REF_OP;
-            break;
+    fr->PC -= 2;
+    return instfunc_getfield_quick(jvm, fr);
+}
 
-        case 'B':
-        case 'C':
-        case 'I':
-        case 'S':
-        case 'Z':
-            type = INT_OP;
-            break;
+uint8_t instfunc_getfield_quick(interpreter_module* jvm, frame* fr)
+{
+    uint16_t index = NEXT_BYTE;
+    index = (index << 8) | NEXT_BYTE;
 
-        default:
-            DEBUG_REPORT_ERROR_INSTRUCTION
-            return 0;
-    }
+    constant_pool_info* field = fr->jc->constant_pool + index - 1;
+    constant_pool_info* cpi = fr->jc->constant_pool + field->Fieldref.name_and_type_index - 1;
+    operand_type type;
+
+    cpi = fr->jc->constant_pool + cpi->NameAndType.descriptor_index - 1;
+    get_field_operand_type(*cpi->Utf8.bytes, &type);
 
     reference* object;
     int32_t object_address;
@@ -2152,7 +2208,19 @@ uint8_t instfunc_getfield(interpreter_module* jvm, frame* fr)
         return 0;
     }
 
-    if (!push_to_stack_operand(&fr->operands, object->ci.data[fi->offset], type))
+    uint8_t* data = INSTANCE_FIELDS(object) + field->Fieldref.resolved_field->offset;
+    int32_t value;
+
+    switch (*cpi->Utf8.bytes)
+    {
+        case 'B': value = *(int8_t*)data; break;
+        case 'Z': value = *data; break;
+        case 'C': value = *(uint16_t*)data; break;
+        case 'S': value = *(int16_t*)data; break;
+        default: value = *(int32_t*)data; break;
+    }
+
+    if (!push_to_stack_operand(&fr->operands, value, type))
     {
         jvm->status = OUT_OF_MEMORY;
         return 0;
@@ -2160,7 +2228,7 @@ uint8_t instfunc_getfield(interpreter_module* jvm, frame* fr)
 
     if (type == LONG_OP || type == DOUBLE_OP)
     {
-        if (!push_to_stack_operand(&fr->operands, object->ci.data[fi->offset + 1], type))
+        if (!push_to_stack_operand(&fr->operands, ((int32_t*)data)[1], type))
         {
             jvm->status = OUT_OF_MEMORY;
             return 0;
@@ -2191,7 +2259,7 @@ uint8_t instfunc_putfield(interpreter_module* jvm, frame* fr)
     cpi1 = fr->jc->constant_pool + cpi2->NameAndType.name_index - 1;
     cpi2 = fr->jc->constant_pool + cpi2->NameAndType.descriptor_index - 1;
 
-    field_info* fi = get_maching_field(fieldLoadedClass->jc, UTF8(cpi1), UTF8(cpi2), 0);
+    field_info* fi = get_field_by_name_and_type(fieldLoadedClass->jc, cpi1, cpi2, 0);
 
     if (!fi)
     {
@@ -2199,7 +2267,7 @@ uint8_t instfunc_putfield(interpreter_module* jvm, frame* fr)
 
         while (super)
         {
-            fi = get_maching_field(super, UTF8(cpi1), UTF8(cpi2), 0);
+            fi = get_field_by_name_and_type(super, cpi1, cpi2, 0);
 
             if (fi)
                 break;
@@ -2208,37 +2276,34 @@ uint8_t instfunc_putfield(interpreter_module* jvm, frame* fr)
         }
     }
 
-    if (!fi)
+    operand_type type;
+
+    if (!fi || !get_field_operand_type(*cpi2->Utf8.bytes, &type))
     {
         DEBUG_REPORT_ERROR_INSTRUCTION
         return 0;
     }
 
-    operand_type type;
+    field->Fieldref.resolved_field = fi;
 
-    switch (*cpi2->Utf8.bytes)
-    {
-        case 'J': type = LONG_OP; break;
-        case 'D': type = DOUBLE_OP; break;
-        case 'F': type = FLOAT_OP; break;
+    if (fieldLoadedClass->init_state == CLASS_INITIALIZED)
+        QUICKEN_INSTRUCTION(3, opcode_putfield_quick);
 
-        case 'L':
-        case '[':
-            type = REF_OP;
-            break;
+    fr->PC -= 2;
+    return instfunc_putfield_quick(jvm, fr);
+}
 
-        case 'B':
-        case 'C':
-        case 'I':
-        case 'S':
-        case 'Z':
-            type = INT_OP;
-            break;
+uint8_t instfunc_putfield_quick(interpreter_module* jvm, frame* fr)
+{
+    uint16_t index = NEXT_BYTE;
+    index = (index << 8) | NEXT_BYTE;
 
-        default:
-            DEBUG_REPORT_ERROR_INSTRUCTION
-            return 0;
-    }
+    constant_pool_info* field = fr->jc->constant_pool + index - 1;
+    constant_pool_info* cpi = fr->jc->constant_pool + field->Fieldref.name_and_type_index - 1;
+    operand_type type;
+
+    cpi = fr->jc->constant_pool + cpi->NameAndType.descriptor_index - 1;
+    get_field_operand_type(*cpi->Utf8.bytes, &type);
 
     reference* object;
     int32_t lo_operand;
@@ -2259,15 +2324,31 @@ uint8_t instfunc_putfield(interpreter_module* jvm, frame* fr)
         return 0;
     }
 
-    if (type == LONG_OP || type == DOUBLE_OP)
+    uint8_t* data = INSTANCE_FIELDS(object) + field->Fieldref.resolved_field->offset;
+
+    switch (*cpi->Utf8.bytes)
     {
-        object->ci.data[fi->offset] = hi_operand;
-        object->ci.data[fi->offset + 1] = lo_operand;
+        case 'J':
+        case 'D':
+            ((int32_t*)data)[0] = hi_operand;
+            ((int32_t*)data)[1] = lo_operand;
+            break;
+
+        case 'B': *(int8_t*)data = (int8_t)lo_operand; break;
+        case 'Z': *data = (uint8_t)(lo_operand & 1); break;
+        case 'C': *(uint16_t*)data = (uint16_t)lo_operand; break;
+        case 'S': *(int16_t*)data = (int16_t)lo_operand; break;
+
+        case 'L':
+        case '[':
+            remember_reference_store(jvm, object, (reference*)*(int32_t*)data, (reference*)lo_operand);
+            *(int32_t*)data = lo_operand;
+            break;
+
+        default:
+            *(int32_t*)data = lo_operand;
+            break;
     }
-    else
-    {
-        object->ci.data[fi->offset] = lo_operand;
-   }
 
     return 1;
 }
@@ -2279,7 +2360,7 @@ uint8_t instfunc_invokevirtual(interpreter_module* jvm, frame* fr)
 
     constant_pool_info* method = fr->jc->constant_pool + index - 1;
     constant_pool_info* cpi1, *cpi2, *cpi3;
-    method_info* mi = NULL;
+    method_signature* signature;
 
     if (jvm->sys_and_str_classes_simulation)
     {
@@ -2290,12 +2371,13 @@ uint8_t instfunc_invokevirtual(interpreter_module* jvm, frame* fr)
         cpi2 = fr->jc->constant_pool + cpi2->NameAndType.name_index - 1;
 
         cpi3 = fr->jc->constant_pool + method->Methodref.name_and_type_index - 1;
+        signature = cpi3->NameAndType.signature;
         cpi3 = fr->jc->constant_pool + cpi3->NameAndType.descriptor_index - 1;
 
         native_func nativeFunc = get_native_func(UTF8(cpi1), UTF8(cpi2), UTF8(cpi3));
 
         if (nativeFunc)
-            return nativeFunc(jvm, fr, UTF8(cpi3));
+            return nativeFunc(jvm, fr, signature);
     }
 
     loaded_classes* methodLoadedClass;
@@ -2307,12 +2389,28 @@ uint8_t instfunc_invokevirtual(interpreter_module* jvm, frame* fr)
         return 0;
     }
 
+    if (methodLoadedClass->init_state == CLASS_INITIALIZED)
+        QUICKEN_INSTRUCTION(3, opcode_invokevirtual_quick);
+
+    fr->PC -= 2;
+    return instfunc_invokevirtual_quick(jvm, fr);
+}
+
+uint8_t instfunc_invokevirtual_quick(interpreter_module* jvm, frame* fr)
+{
+    uint16_t index = NEXT_BYTE;
+    index = (index << 8) | NEXT_BYTE;
+
+    constant_pool_info* method = fr->jc->constant_pool + index - 1;
+    constant_pool_info* cpi1, *cpi2;
+    method_info* mi = NULL;
+
     cpi2 = fr->jc->constant_pool + method->Methodref.name_and_type_index - 1;
     cpi1 = fr->jc->constant_pool + cpi2->NameAndType.name_index - 1;
     cpi2 = fr->jc->constant_pool + cpi2->NameAndType.descriptor_index - 1;
 
     uint8_t operandIndex;
-    uint8_t parameterCount = get_method_descriptor_param_cout(UTF8(cpi2));
+    uint8_t parameterCount = fr->jc->constant_pool[method->Methodref.name_and_type_index - 1].NameAndType.signature->argument_slots;
     stack_operand* node = fr->operands;
 
     for (operandIndex = 0; operandIndex < parameterCount; operandIndex++)
@@ -2325,7 +2423,7 @@ uint8_t instfunc_invokevirtual(interpreter_module* jvm, frame* fr)
     {
         while (jc)
         {
-            mi = get_matching_method(jc, UTF8(cpi1), UTF8(cpi2), 0);
+            mi = get_method_by_name_and_type(jc, cpi1, cpi2, 0);
 
             if (mi)
                 break;
@@ -2356,6 +2454,7 @@ uint8_t instfunc_invokespecial(interpreter_module* jvm, frame* fr)
     constant_pool_info* method = fr->jc->constant_pool + index - 1;
     constant_pool_info* cpi1, *cpi2;
     method_info* mi = NULL;
+    java_class* target;
 
     loaded_classes* methodLoadedClass;
 
@@ -2369,19 +2468,20 @@ uint8_t instfunc_invokespecial(interpreter_module* jvm, frame* fr)
     cpi2 = fr->jc->constant_pool + method->Methodref.name_and_type_index - 1;
     cpi1 = fr->jc->constant_pool + cpi2->NameAndType.name_index - 1;
     cpi2 = fr->jc->constant_pool + cpi2->NameAndType.descriptor_index - 1;
+    target = methodLoadedClass->jc;
 
-    if (!compare_utf8(UTF8(cpi1), (const uint8_t*)"<init>", 6) &&
+    if (cpi1->Utf8.sym != jvm->init_symbol &&
         (fr->jc->access_flags & SUPER_ACCESS_FLAG) && is_super_class_of_given_class(jvm, methodLoadedClass->jc, fr->jc))
     {
         java_class* super = get_super_class_of_given_class(jvm, fr->jc);
 
         while (super)
         {
-            mi = get_matching_method(super, UTF8(cpi1), UTF8(cpi2), 0);
+            mi = get_method_by_name_and_type(super, cpi1, cpi2, 0);
 
             if (mi)
             {
-                methodLoadedClass->jc = super;
+                target = super;
                 break;
             }
 
@@ -2396,7 +2496,7 @@ uint8_t instfunc_invokespecial(interpreter_module* jvm, frame* fr)
     }
     else
     {
-        mi = get_matching_method(methodLoadedClass->jc, UTF8(cpi1), UTF8(cpi2), 0);
+        mi = get_method_by_name_and_type(target, cpi1, cpi2, 0);
     }
 
     if (!mi)
@@ -2405,9 +2505,25 @@ uint8_t instfunc_invokespecial(interpreter_module* jvm, frame* fr)
         return 0;
     }
 
-    uint8_t parameterCount = 1 + get_method_descriptor_param_cout(UTF8(cpi2));
+    method->Methodref.resolved_method = mi;
+    method->Methodref.resolved_target = target;
+
+    if (methodLoadedClass->init_state == CLASS_INITIALIZED)
+        QUICKEN_INSTRUCTION(3, opcode_invokespecial_quick);
 
-    return run_method(jvm, methodLoadedClass->jc, mi, parameterCount);
+    fr->PC -= 2;
+    return instfunc_invokespecial_quick(jvm, fr);
+}
+
+uint8_t instfunc_invokespecial_quick(interpreter_module* jvm, frame* fr)
+{
+    uint16_t index = NEXT_BYTE;
+    index = (index << 8) | NEXT_BYTE;
+
+    constant_pool_info* method = fr->jc->constant_pool + index - 1;
+    method_info* mi = method->Methodref.resolved_method;
+
+    return run_method(jvm, method->Methodref.resolved_target, mi, 1 + mi->signature.argument_slots);
 }
 
 uint8_t instfunc_invokestatic(interpreter_module* jvm, frame* fr)
@@ -2417,6 +2533,7 @@ uint8_t instfunc_invokestatic(interpreter_module* jvm, frame* fr)
 
     constant_pool_info* method = fr->jc->constant_pool + index - 1;
     constant_pool_info* cpi1, *cpi2, *cpi3;
+    method_signature* signature;
 
     if (jvm->sys_and_str_classes_simulation)
     {
@@ -2427,12 +2544,13 @@ uint8_t instfunc_invokestatic(interpreter_module* jvm, frame* fr)
         cpi2 = fr->jc->constant_pool + cpi2->NameAndType.name_index - 1;
 
         cpi3 = fr->jc->constant_pool + method->Methodref.name_and_type_index - 1;
+        signature = cpi3->NameAndType.signature;
         cpi3 = fr->jc->constant_pool + cpi3->NameAndType.descriptor_index - 1;
 
         native_func nativeFunc = get_native_func(UTF8(cpi1), UTF8(cpi2), UTF8(cpi3));
 
         if (nativeFunc)
-            return nativeFunc(jvm, fr, UTF8(cpi3));
+            return nativeFunc(jvm, fr, signature);
     }
 
     loaded_classes* methodLoadedClass;
@@ -2448,7 +2566,7 @@ uint8_t instfunc_invokestatic(interpreter_module* jvm, frame* fr)
     cpi1 = fr->jc->constant_pool + cpi2->NameAndType.name_index - 1;
     cpi2 = fr->jc->constant_pool + cpi2->NameAndType.descriptor_index - 1;
 
-    method_info* mi = get_matching_method(methodLoadedClass->jc, UTF8(cpi1), UTF8(cpi2), 0);
+    method_info* mi = get_method_by_name_and_type(methodLoadedClass->jc, cpi1, cpi2, 0);
 
     if (!mi)
     {
@@ -2456,7 +2574,25 @@ uint8_t instfunc_invokestatic(interpreter_module* jvm, frame* fr)
         return 0;
     }
 
-    return run_method(jvm, methodLoadedClass->jc, mi, get_method_descriptor_param_cout(UTF8(cpi2)));
+    method->Methodref.resolved_method = mi;
+    method->Methodref.resolved_target = methodLoadedClass->jc;
+
+    if (methodLoadedClass->init_state == CLASS_INITIALIZED)
+        QUICKEN_INSTRUCTION(3, opcode_invokestatic_quick);
+
+    fr->PC -= 2;
+    return instfunc_invokestatic_quick(jvm, fr);
+}
+
+uint8_t instfunc_invokestatic_quick(interpreter_module* jvm, frame* fr)
+{
+    uint16_t index = NEXT_BYTE;
+    index = (index << 8) | NEXT_BYTE;
+
+    constant_pool_info* method = fr->jc->constant_pool + index - 1;
+    method_info* mi = method->Methodref.resolved_method;
+
+    return run_method(jvm, method->Methodref.resolved_target, mi, mi->signature.argument_slots);
 }
 
 uint8_t instfunc_invokeinterface(interpreter_module* jvm, frame* fr)
@@ -2467,8 +2603,6 @@ uint8_t instfunc_invokeinterface(interpreter_module* jvm, frame* fr)
     fr->PC += 2;
 
     constant_pool_info* method = fr->jc->constant_pool + index - 1;
-    constant_pool_info* cpi1, *cpi2;
-    method_info* mi = NULL;
 
     loaded_classes* methodLoadedClass;
 
@@ -2479,12 +2613,30 @@ uint8_t instfunc_invokeinterface(interpreter_module* jvm, frame* fr)
         return 0;
     }
 
+    if (methodLoadedClass->init_state == CLASS_INITIALIZED)
+        QUICKEN_INSTRUCTION(5, opcode_invokeinterface_quick);
+
+    fr->PC -= 4;
+    return instfunc_invokeinterface_quick(jvm, fr);
+}
+
+uint8_t instfunc_invokeinterface_quick(interpreter_module* jvm, frame* fr)
+{
+    uint16_t index = NEXT_BYTE;
+    index = (index << 8) | NEXT_BYTE;
+
+    fr->PC += 2;
+
+    constant_pool_info* method = fr->jc->constant_pool + index - 1;
+    constant_pool_info* cpi1, *cpi2;
+    method_info* mi = NULL;
+
     cpi2 = fr->jc->constant_pool + method->Methodref.name_and_type_index - 1;
     cpi1 = fr->jc->constant_pool + cpi2->NameAndType.name_index - 1;
     cpi2 = fr->jc->constant_pool + cpi2->NameAndType.descriptor_index - 1;
 
     uint8_t operandIndex;
-    uint8_t parameterCount = get_method_descriptor_param_cout(UTF8(cpi2));
+    uint8_t parameterCount = fr->jc->constant_pool[method->Methodref.name_and_type_index - 1].NameAndType.signature->argument_slots;
     stack_operand* node = fr->operands;
 
     for (operandIndex = 0; operandIndex < parameterCount; operandIndex++)
@@ -2498,7 +2650,7 @@ uint8_t instfunc_invokeinterface(interpreter_module* jvm, frame* fr)
 
         while (jc)
         {
-            mi = get_matching_method(jc, UTF8(cpi1), UTF8(cpi2), 0);
+            mi = get_method_by_name_and_type(jc, cpi1, cpi2, 0);
 
             if (mi)
                 break;
@@ -2551,7 +2703,29 @@ uint8_t instfunc_new(interpreter_module* jvm, frame* fr)
         return 0;
     }
 
-    reference* instance = create_new_class_instance(jvm, instanceLoadedClass);
+    if (!initialize_class(jvm, instanceLoadedClass))
+    {
+        jvm->status = OUT_OF_MEMORY;
+        return 0;
+    }
+
+    fr->jc->constant_pool[index - 1].Class.resolved_class = instanceLoadedClass;
+
+    if (instanceLoadedClass->init_state == CLASS_INITIALIZED)
+        QUICKEN_INSTRUCTION(3, opcode_new_quick);
+
+    fr->PC -= 2;
+    return instfunc_new_quick(jvm, fr);
+}
+
+uint8_t instfunc_new_quick(interpreter_module* jvm, frame* fr)
+{
+    uint16_t index;
+
+    index = NEXT_BYTE;
+    index = (index << 8) | NEXT_BYTE;
+
+    reference* instance = allocate_class_instance(jvm, fr->jc->constant_pool[index - 1].Class.resolved_class);
 
     if (!instance || !push_to_stack_operand(&fr->operands, (int32_t)instance, REF_OP))
     {
@@ -2840,7 +3014,7 @@ uint8_t instfunc_jsr_w(interpreter_module* jvm, frame* fr)
 
 instruction_fun fetchOpcodeFunction(uint8_t opcode)
 {
-    const instruction_fun opcodeFunctions[202] = {
+    const instruction_fun opcodeFunctions[opcode_new_quick + 1] = {
         instfunc_nop, instfunc_aconst_null, instfunc_iconst_m1,
         instfunc_iconst_0, instfunc_iconst_1, instfunc_iconst_2,
         instfunc_iconst_3, instfunc_iconst_4, instfunc_iconst_5,
@@ -2908,10 +3082,13 @@ instruction_fun fetchOpcodeFunction(uint8_t opcode)
         instfunc_checkcast, instfunc_instanceof, instfunc_monitorenter,
         instfunc_monitorexit, instfunc_wide, instfunc_multianewarray,
         instfunc_ifnull, instfunc_ifnonnull, instfunc_goto_w,
-        instfunc_jsr_w
+        instfunc_jsr_w, NULL, instfunc_getstatic_quick,
+        instfunc_putstatic_quick, instfunc_getfield_quick, instfunc_putfield_quick,
+        instfunc_invokevirtual_quick, instfunc_invokespecial_quick, instfunc_invokestatic_quick,
+        instfunc_invokeinterface_quick, instfunc_new_quick
     };
 
-    if (opcode > 201)
+    if (opcode > opcode_new_quick)
         return NULL;
 
     return opcodeFunctions[opcode];
@@ -0,0 +1,219 @@
+#include <stdlib.h>
+#include <string.h>
+#include "jararchive.h"
+#include "mappedfile.h"
+#include "inflate.h"
+#include "utf8.h"
+
+#define END_OF_CENTRAL_DIRECTORY_SIGNATURE 0x06054B50UL
+#define CENTRAL_DIRECTORY_SIGNATURE 0x02014B50UL
+#define LOCAL_HEADER_SIGNATURE 0x04034B50UL
+
+#define END_OF_CENTRAL_DIRECTORY_SIZE 22
+#define CENTRAL_DIRECTORY_HEADER_SIZE 46
+#define LOCAL_HEADER_SIZE 30
+
+#define COMPRESSION_STORED 0
+#define COMPRESSION_DEFLATED 8
+#define FLAG_ENCRYPTED 0x0001
+
+static uint16_t read_u2_le(const uint8_t* bytes)
+{
+    return (uint16_t)(bytes[0] | (bytes[1] << 8));
+}
+
+static uint32_t read_u4_le(const uint8_t* bytes)
+{
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static uint8_t index_central_directory(jar_archive* jar)
+{
+    const uint8_t* end_record = NULL;
+    const uint8_t* header;
+    uint32_t offset, directory_offset, directory_size;
+    uint32_t table_size = 1;
+    uint32_t index;
+
+    if (jar->image_length < END_OF_CENTRAL_DIRECTORY_SIZE)
+        return 0;
+
+    // The end record is followed by a comment of up to 65535 bytes, so scan
+    // backwards for its signature.
+    offset = jar->image_length - END_OF_CENTRAL_DIRECTORY_SIZE;
+
+    do
+    {
+        if (read_u4_le(jar->image + offset) == END_OF_CENTRAL_DIRECTORY_SIGNATURE)
+        {
+            end_record = jar->image + offset;
+            break;
+        }
+    } while (offset-- > 0 && jar->image_length - offset <= END_OF_CENTRAL_DIRECTORY_SIZE + 65535);
+
+    if (!end_record)
+        return 0;
+
+    jar->entry_count = read_u2_le(end_record + 10);
+    directory_size = read_u4_le(end_record + 12);
+    directory_offset = read_u4_le(end_record + 16);
+
+    if (directory_offset > jar->image_length || jar->image_length - directory_offset < directory_size)
+        return 0;
+
+    while (table_size < jar->entry_count * 2)
+        table_size <<= 1;
+
+    jar->entries = (jar_entry*)malloc(sizeof(jar_entry) * (jar->entry_count ? jar->entry_count : 1));
+    jar->entry_table = (jar_entry**)calloc(table_size, sizeof(jar_entry*));
+    jar->entry_table_mask = table_size - 1;
+
+    if (!jar->entries || !jar->entry_table)
+        return 0;
+
+    header = jar->image + directory_offset;
+
+    for (index = 0; index < jar->entry_count; index++)
+    {
+        jar_entry* entry = jar->entries + index;
+        uint32_t header_length;
+
+        if ((uint32_t)(jar->image + directory_offset + directory_size - header) < CENTRAL_DIRECTORY_HEADER_SIZE ||
+            read_u4_le(header) != CENTRAL_DIRECTORY_SIGNATURE)
+        {
+            return 0;
+        }
+
+        header_length = CENTRAL_DIRECTORY_HEADER_SIZE + read_u2_le(header + 28) + read_u2_le(header + 30) + read_u2_le(header + 32);
+
+        if ((uint32_t)(jar->image + directory_offset + directory_size - header) < header_length)
+            return 0;
+
+        entry->compression_method = (read_u2_le(header + 8) & FLAG_ENCRYPTED) ? 0xFFFF : read_u2_le(header + 10);
+        entry->compressed_size = read_u4_le(header + 20);
+        entry->uncompressed_size = read_u4_le(header + 24);
+        entry->name_length = read_u2_le(header + 28);
+        entry->local_header_offset = read_u4_le(header + 42);
+        entry->name = header + CENTRAL_DIRECTORY_HEADER_SIZE;
+        entry->hash = utf8_hash(entry->name, entry->name_length);
+
+        entry->next = jar->entry_table[entry->hash & jar->entry_table_mask];
+        jar->entry_table[entry->hash & jar->entry_table_mask] = entry;
+
+        header += header_length;
+    }
+
+    return 1;
+}
+
+jar_archive* open_jar_archive(const char* path)
+{
+    jar_archive* jar = (jar_archive*)malloc(sizeof(jar_archive));
+
+    if (!jar)
+        return NULL;
+
+    jar->image = NULL;
+    jar->image_length = 0;
+    jar->image_mapped = 0;
+    jar->entries = NULL;
+    jar->entry_count = 0;
+    jar->entry_table = NULL;
+    jar->entry_table_mask = 0;
+
+    if (!map_file(path, &jar->image, &jar->image_length, &jar->image_mapped) || !index_central_directory(jar))
+    {
+        close_jar_archive(jar);
+        return NULL;
+    }
+
+    return jar;
+}
+
+void close_jar_archive(jar_archive* jar)
+{
+    if (!jar)
+        return;
+
+    unmap_file(jar->image, jar->image_length, jar->image_mapped);
+
+    if (jar->entries)
+        free(jar->entries);
+
+    if (jar->entry_table)
+        free(jar->entry_table);
+
+    free(jar);
+}
+
+jar_entry* find_jar_entry(jar_archive* jar, const uint8_t* name, int32_t name_length)
+{
+    uint32_t hash = utf8_hash(name, name_length);
+    jar_entry* entry;
+
+    for (entry = jar->entry_table[hash & jar->entry_table_mask]; entry; entry = entry->next)
+    {
+        if (entry->hash == hash && entry->name_length == name_length &&
+            memcmp(entry->name, name, name_length) == 0)
+        {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+uint8_t read_jar_entry(jar_archive* jar, jar_entry* entry, const uint8_t** data, uint8_t** inflated)
+{
+    const uint8_t* header;
+    const uint8_t* compressed;
+    uint32_t data_offset;
+
+    *data = NULL;
+    *inflated = NULL;
+
+    if (entry->local_header_offset > jar->image_length ||
+        jar->image_length - entry->local_header_offset < LOCAL_HEADER_SIZE)
+    {
+        return 0;
+    }
+
+    header = jar->image + entry->local_header_offset;
+
+    if (read_u4_le(header) != LOCAL_HEADER_SIGNATURE)
+        return 0;
+
+    data_offset = entry->local_header_offset + LOCAL_HEADER_SIZE + read_u2_le(header + 26) + read_u2_le(header + 28);
+
+    if (data_offset > jar->image_length || jar->image_length - data_offset < entry->compressed_size)
+        return 0;
+
+    compressed = jar->image + data_offset;
+
+    if (entry->compression_method == COMPRESSION_STORED)
+    {
+        if (entry->compressed_size != entry->uncompressed_size)
+            return 0;
+
+        *data = compressed;
+        return 1;
+    }
+
+    if (entry->compression_method != COMPRESSION_DEFLATED)
+        return 0;
+
+    *inflated = (uint8_t*)malloc(entry->uncompressed_size ? entry->uncompressed_size : 1);
+
+    if (!*inflated)
+        return 0;
+
+    if (!inflate_data(compressed, entry->compressed_size, *inflated, entry->uncompressed_size))
+    {
+        free(*inflated);
+        *inflated = NULL;
+        return 0;
+    }
+
+    *data = *inflated;
+    return 1;
+}
@@ -0,0 +1,34 @@
+#ifndef JARARCHIVE_H
+#define JARARCHIVE_H
+
+#include <stdint.h>
+
+typedef struct jar_entry
+{
+    uint32_t hash;
+    const uint8_t* name;
+    uint16_t name_length;
+    uint16_t compression_method;
+    uint32_t compressed_size;
+    uint32_t uncompressed_size;
+    uint32_t local_header_offset;
+    struct jar_entry* next;
+} jar_entry;
+
+typedef struct jar_archive
+{
+    const uint8_t* image;
+    uint32_t image_length;
+    uint8_t image_mapped;
+    jar_entry* entries;
+    uint32_t entry_count;
+    jar_entry** entry_table;
+    uint32_t entry_table_mask;
+} jar_archive;
+
+jar_archive* open_jar_archive(const char*);
+void close_jar_archive(jar_archive*);
+jar_entry* find_jar_entry(jar_archive*, const uint8_t*, int32_t);
+uint8_t read_jar_entry(jar_archive*, jar_entry*, const uint8_t**, uint8_t**);
+
+#endif
@@ -3,21 +3,57 @@
 #include "constantpool.h"
 #include "utf8.h"
 #include "validity.h"
+#include "mappedfile.h"
+#include "sharedarchive.h"
 #include <stdlib.h>
+#include <string.h>
 
-void open_class_file(java_class* jc, const char* path) {
-    if (!jc)
+static uint8_t retain_class_images = 0;
+static verification_cache* class_verification_cache = NULL;
+
+void set_class_image_retention(uint8_t retain)
+{
+    retain_class_images = retain;
+}
+
+// Only a shared archive dump needs to know which file a class came from.
+void set_class_source(java_class* jc, const char* path)
+{
+    size_t length = strlen(path) + 1;
+    char* copy;
+
+    if (!retain_class_images || jc->status != CLASS_STA_OK)
         return;
 
-    uint32_t u32;
-    uint16_t u16;
+    copy = (char*)allocate_from_arena(&jc->memory, length);
 
-    jc->file = fopen(path, "rb");
+    if (copy)
+    {
+        memcpy(copy, path, length);
+        jc->source_path = copy;
+    }
+}
+
+void set_class_verification_cache(verification_cache* cache)
+{
+    class_verification_cache = cache;
+}
+
+static void initialize_class_fields(java_class* jc)
+{
+    jc->image = NULL;
+    jc->image_length = 0;
+    jc->image_source = CLASS_IMAGE_NONE;
+    jc->code_image = NULL;
+    jc->source_path = NULL;
     jc->minor_version = jc->major_version = jc->constant_pool_count = 0;
     jc->constant_pool = NULL;
     jc->interfaces = NULL;
     jc->fields = NULL;
     jc->methods = NULL;
+    jc->field_index = NULL;
+    jc->method_index = NULL;
+    jc->field_index_mask = jc->method_index_mask = 0;
     jc->attributes = NULL;
     jc->status = CLASS_STA_OK;
     jc->class_name_mismatch = 0;
@@ -26,24 +62,138 @@ void open_class_file(java_class* jc, const char* path) {
     jc->attribute_count = jc->field_count = jc->method_count = jc->constant_pool_count = jc->interface_count = 0;
 
     jc->static_field_count = 0;
-    jc->instance_field_count = 0;
+    jc->instance_size = 0;
+    jc->reference_slot_count = 0;
+    jc->reference_slots = NULL;
+    jc->layout_archived = 0;
+
+    initialize_arena(&jc->memory, ARENA_DEFAULT_BLOCK_SIZE);
+    jc->reader = NULL;
+}
+
+static void begin_class_reading(java_class* jc, class_reader* reader)
+{
+    reader->verified_image = 0;
+    reader->last_tag_read = 0;
+    reader->total_bytes_read = 0;
+    reader->constant_pool_entries_read = 0;
+    reader->attribute_entries_read = 0;
+    reader->interface_entries_read = 0;
+    reader->field_entries_read = 0;
+    reader->method_entries_read = 0;
+    reader->validity_entries_checked = 0;
+
+    jc->reader = reader;
+}
+
+static void release_class_image(java_class* jc)
+{
+    if (jc->image_source == CLASS_IMAGE_MAPPED || jc->image_source == CLASS_IMAGE_ALLOCATED)
+        unmap_file(jc->image, jc->image_length, jc->image_source == CLASS_IMAGE_MAPPED);
 
-    jc->last_tag_read = 0;
-    jc->total_bytes_read = 0;
-    jc->constant_pool_entries_read = 0;
-    jc->attribute_entries_read = 0;
-    jc->constant_pool_entries_read = 0;
-    jc->interface_entries_read = 0;
-    jc->field_entries_read = 0;
-    jc->method_entries_read = 0;
-    jc->validity_entries_checked = 0;
+    jc->image = NULL;
+    jc->image_length = 0;
+    jc->image_source = CLASS_IMAGE_NONE;
+}
+
+static void detach_class_image(java_class* jc)
+{
+    uint16_t u16;
 
-    if (!jc->file)
+    for (u16 = 0; u16 + 1 < jc->constant_pool_count; u16++)
     {
-        jc->status = CLASS_STA_FILE_CN_BE_OPENED;
-        return;
+        if (jc->constant_pool[u16].tag == UTF8_CONST)
+            jc->constant_pool[u16].Utf8.bytes = jc->constant_pool[u16].Utf8.sym->bytes;
+        else if (jc->constant_pool[u16].tag == DOUBLE_CONST || jc->constant_pool[u16].tag == LONG_CONST)
+            u16++;
     }
 
+    release_class_image(jc);
+}
+
+static void finish_class_reading(java_class* jc)
+{
+    class_reader* reader = jc->reader;
+
+    jc->reader = NULL;
+
+    if (jc->status == CLASS_STA_OK && jc->image_source != CLASS_IMAGE_BORROWED && !retain_class_images)
+    {
+        if (detach_code_attributes(jc))
+            detach_class_image(jc);
+        else
+            jc->status = MEM_ALLOC_FAILED;
+    }
+
+    if (jc->status != CLASS_STA_OK)
+    {
+        jc->reader = (class_reader*)allocate_from_arena(&jc->memory, sizeof(class_reader));
+
+        if (jc->reader)
+            *jc->reader = *reader;
+    }
+}
+
+static uint8_t load_class_image(java_class* jc, const char* path)
+{
+    uint8_t mapped;
+
+    if (!map_file(path, &jc->image, &jc->image_length, &mapped))
+        return 0;
+
+    jc->image_source = mapped ? CLASS_IMAGE_MAPPED : CLASS_IMAGE_ALLOCATED;
+
+    return 1;
+}
+
+static uint8_t build_method_signatures(java_class* jc)
+{
+    constant_pool_info* cpi;
+    constant_pool_info* descriptor;
+    uint16_t u16;
+
+    for (u16 = 0; u16 + 1 < jc->constant_pool_count; u16++)
+    {
+        cpi = jc->constant_pool + u16;
+
+        if (cpi->tag == DOUBLE_CONST || cpi->tag == LONG_CONST)
+        {
+            u16++;
+            continue;
+        }
+
+        if (cpi->tag != NAMEANDTYPE_CONST)
+            continue;
+
+        cpi->NameAndType.signature = NULL;
+        descriptor = jc->constant_pool + cpi->NameAndType.descriptor_index - 1;
+
+        if (descriptor->tag != UTF8_CONST || descriptor->Utf8.length == 0 || *descriptor->Utf8.bytes != '(')
+            continue;
+
+        cpi->NameAndType.signature = (method_signature*)allocate_from_arena(&jc->memory, sizeof(method_signature));
+
+        if (!cpi->NameAndType.signature)
+        {
+            jc->status = MEM_ALLOC_FAILED;
+            return 0;
+        }
+
+        if (!read_method_signature(jc, UTF8(descriptor), cpi->NameAndType.signature))
+            return 0;
+    }
+
+    return 1;
+}
+
+static void read_class_image(java_class* jc, const char* path)
+{
+    if (jc->image_length / 2 > ARENA_DEFAULT_BLOCK_SIZE)
+        jc->memory.block_size = jc->image_length / 2;
+
+    uint32_t u32;
+    uint16_t u16;
+
     if (!read_4_byte_unsigned(jc, &u32) || u32 != 0xCAFEBABE)
     {
         jc->status = CLASS_STA_INV_SIGN;
@@ -72,7 +222,7 @@ void open_class_file(java_class* jc, const char* path) {
 
     if (jc->constant_pool_count > 1)
     {
-        jc->constant_pool = (constant_pool_info*)malloc(sizeof(constant_pool_info) * (jc->constant_pool_count - 1));
+        jc->constant_pool = (constant_pool_info*)allocate_from_arena(&jc->memory, sizeof(constant_pool_info) * (jc->constant_pool_count - 1));
 
         if (!jc->constant_pool)
         {
@@ -94,10 +244,13 @@ void open_class_file(java_class* jc, const char* path) {
                 u16++;
             }
 
-            jc->constant_pool_entries_read++;
+            jc->reader->constant_pool_entries_read++;
         }
 
-        if (!check_constant_pool_is_valid(jc))
+        if (!jc->reader->verified_image && !check_constant_pool_is_valid(jc))
+            return;
+
+        if (!build_method_signatures(jc))
             return;
     }
 
@@ -112,7 +265,7 @@ void open_class_file(java_class* jc, const char* path) {
     if (!check_access_flags_and_class_idx(jc))
         return;
 
-    if (!check_class_name_mathcing_with_file(jc, path))
+    if (path && !check_class_name_mathcing_with_file(jc, path))
         jc->class_name_mismatch = 1;
 
     if (!read_2_byte_unsigned(jc, &jc->interface_count))
@@ -123,7 +276,7 @@ void open_class_file(java_class* jc, const char* path) {
 
     if (jc->interface_count > 0)
     {
-        jc->interfaces = (uint16_t*)malloc(sizeof(uint16_t) * jc->interface_count);
+        jc->interfaces = (uint16_t*)allocate_from_arena(&jc->memory, sizeof(uint16_t) * jc->interface_count);
 
         if (!jc->interfaces)
         {
@@ -146,7 +299,7 @@ void open_class_file(java_class* jc, const char* path) {
             }
 
             *(jc->interfaces + u32) = u16;
-            jc->interface_entries_read++;
+            jc->reader->interface_entries_read++;
         }
     }
 
@@ -158,7 +311,7 @@ void open_class_file(java_class* jc, const char* path) {
 
     if (jc->field_count > 0)
     {
-        jc->fields = (field_info*)malloc(sizeof(field_info) * jc->field_count);
+        jc->fields = (field_info*)allocate_from_arena(&jc->memory, sizeof(field_info) * jc->field_count);
 
         if (!jc->fields)
         {
@@ -177,22 +330,23 @@ void open_class_file(java_class* jc, const char* path) {
                 return;
             }
 
-            isCat2 = *jc->constant_pool[field->descriptor_index - 1].Utf8.bytes;
-            isCat2 = isCat2 == 'J' || isCat2 == 'D';
-
+            // Instance field offsets depend on the superclass and are
+            // assigned when the class is linked.
             if (field->access_flags & STATIC_ACCESS_FLAG)
             {
+                isCat2 = *jc->constant_pool[field->descriptor_index - 1].Utf8.bytes;
+                isCat2 = isCat2 == 'J' || isCat2 == 'D';
+
                 field->offset = jc->static_field_count++;
                 jc->static_field_count += isCat2;
             }
             else
             {
-                field->offset = jc->instance_field_count++;
-                jc->instance_field_count += isCat2;
+                field->offset = 0;
             }
 
 
-            jc->field_entries_read++;
+            jc->reader->field_entries_read++;
         }
     }
 
@@ -204,7 +358,7 @@ void open_class_file(java_class* jc, const char* path) {
 
     if (jc->method_count > 0)
     {
-        jc->methods = (method_info*)malloc(sizeof(method_info) * jc->method_count);
+        jc->methods = (method_info*)allocate_from_arena(&jc->memory, sizeof(method_info) * jc->method_count);
 
         if (!jc->methods)
         {
@@ -220,10 +374,16 @@ void open_class_file(java_class* jc, const char* path) {
                 return;
             }
 
-            jc->method_entries_read++;
+            jc->reader->method_entries_read++;
         }
     }
 
+    if (!build_field_index(jc) || !build_method_index(jc))
+    {
+        jc->status = MEM_ALLOC_FAILED;
+        return;
+    }
+
     if (!read_2_byte_unsigned(jc, &jc->attribute_count))
     {
         jc->status = UNXPTD_EOF;
@@ -232,8 +392,8 @@ void open_class_file(java_class* jc, const char* path) {
 
     if (jc->attribute_count > 0)
     {
-        jc->attribute_entries_read = 0;
-        jc->attributes = (attribute_info*)malloc(sizeof(attribute_info) * jc->attribute_count);
+        jc->reader->attribute_entries_read = 0;
+        jc->attributes = (attribute_info*)allocate_from_arena(&jc->memory, sizeof(attribute_info) * jc->attribute_count);
 
         if (!jc->attributes)
         {
@@ -249,80 +409,130 @@ void open_class_file(java_class* jc, const char* path) {
                 return;
             }
 
-            jc->attribute_entries_read++;
+            jc->reader->attribute_entries_read++;
         }
     }
 
-    if (fgetc(jc->file) != EOF)
-    {
+    if (jc->reader->total_bytes_read != jc->image_length)
         jc->status = FILE_CONTAINS_UNXPTD_DATA;
-    }
-    else
+}
+
+static void parse_class_image(java_class* jc, const char* path)
+{
+    class_digest digest;
+    uint8_t record_digest = 0;
+
+    // Images whose digest is already cached were verified by an earlier run.
+    if (class_verification_cache && !jc->reader->verified_image)
     {
-        fclose(jc->file);
-        jc->file = NULL;
+        compute_class_digest(jc->image, jc->image_length, &digest);
+        jc->reader->verified_image = class_digest_is_verified(class_verification_cache, &digest);
+        record_digest = !jc->reader->verified_image;
     }
 
+    read_class_image(jc, path);
+
+    if (record_digest && jc->status == CLASS_STA_OK)
+        add_verified_class_digest(class_verification_cache, &digest);
 }
 
-void close_class_file(java_class* jc) {
+void open_class_file(java_class* jc, const char* path) {
     if (!jc)
         return;
 
-    uint16_t i;
+    class_reader reader;
 
-    if (jc->file)
-    {
-        fclose(jc->file);
-        jc->file = NULL;
-    }
+    initialize_class_fields(jc);
+    begin_class_reading(jc, &reader);
 
-    if (jc->interfaces)
-    {
-        free(jc->interfaces);
-        jc->interfaces = NULL;
-        jc->interface_count = 0;
-    }
+    if (load_class_image(jc, path))
+        parse_class_image(jc, path);
+    else if (jc->status == CLASS_STA_OK)
+        jc->status = CLASS_STA_FILE_CN_BE_OPENED;
 
-    if (jc->constant_pool)
-    {
-        for (i = 0; i < jc->constant_pool_count - 1; i++)
-        {
-            if (jc->constant_pool[i].tag == UTF8_CONST && jc->constant_pool[i].Utf8.bytes)
-                free(jc->constant_pool[i].Utf8.bytes);
-        }
+    finish_class_reading(jc);
+}
 
-        free(jc->constant_pool);
-        jc->constant_pool = NULL;
-        jc->constant_pool_count = 0;
-    }
+void open_class_from_memory(java_class* jc, const uint8_t* bytes, uint32_t length, const char* path) {
+    if (!jc)
+        return;
 
-    if (jc->methods)
-    {
-        for (i = 0; i < jc->method_count; i++)
-            free_method_attributes(jc->methods + i);
+    class_reader reader;
 
-        free(jc->methods);
-        jc->method_count = 0;
-    }
+    initialize_class_fields(jc);
+    begin_class_reading(jc, &reader);
 
-    if (jc->fields)
-    {
-        for (i = 0; i < jc->field_count; i++)
-            free_field_attributes(jc->fields + i);
+    jc->image = bytes;
+    jc->image_length = length;
+    jc->image_source = CLASS_IMAGE_BORROWED;
 
-        free(jc->fields);
-        jc->field_count = 0;
-    }
+    parse_class_image(jc, path);
+    finish_class_reading(jc);
+}
 
-    if (jc->attributes)
-    {
-        for (i = 0; i < jc->attribute_count; i++)
-            free_attribute_info(jc->attributes + i);
+void open_class_from_buffer(java_class* jc, uint8_t* buffer, uint32_t length, const char* path) {
+    if (!jc)
+        return;
 
-        free(jc->attributes);
-        jc->attribute_count = 0;
-    }
+    class_reader reader;
+
+    initialize_class_fields(jc);
+    begin_class_reading(jc, &reader);
+
+    jc->image = buffer;
+    jc->image_length = length;
+    jc->image_source = CLASS_IMAGE_ALLOCATED;
+
+    parse_class_image(jc, path);
+    finish_class_reading(jc);
+}
+
+void open_verified_class_from_memory(java_class* jc, const uint8_t* bytes, uint32_t length) {
+    if (!jc)
+        return;
+
+    class_reader reader;
+
+    initialize_class_fields(jc);
+    begin_class_reading(jc, &reader);
+    reader.verified_image = 1;
+
+    jc->image = bytes;
+    jc->image_length = length;
+    jc->image_source = CLASS_IMAGE_BORROWED;
+
+    parse_class_image(jc, NULL);
+    finish_class_reading(jc);
+}
+
+// Returns 0, leaving jc unopened, when the archive holds no usable copy of
+// the class.
+uint8_t open_shared_class(java_class* jc, shared_archive* archive, const uint8_t* name, int32_t name_length) {
+    initialize_class_fields(jc);
+
+    if (restore_shared_class(archive, name, name_length, jc))
+        return 1;
+
+    close_class_file(jc);
+    return 0;
+}
+
+void close_class_file(java_class* jc) {
+    if (!jc)
+        return;
+
+    release_class_image(jc);
+    release_arena(&jc->memory);
+
+    jc->reader = NULL;
+    jc->constant_pool = NULL;
+    jc->interfaces = NULL;
+    jc->fields = NULL;
+    jc->methods = NULL;
+    jc->attributes = NULL;
+    jc->field_index = NULL;
+    jc->method_index = NULL;
+    jc->constant_pool_count = jc->interface_count = jc->field_count = jc->method_count = jc->attribute_count = 0;
 }
 
 const char* decode_java_class_status(enum java_class_status status) {
@@ -365,6 +575,7 @@ const char* decode_java_class_status(enum java_class_status status) {
         case ATTR_INV_INNERCLASS_IDXS: return "InnerClass has at least one invalid index";
         case ATTR_INV_EXC_CLASS_IDX: return "Exceptions has an index that doesn't point to a valid class";
         case ATTR_INV_CODE_LEN: return "Attribute code must have a length greater than 0 and less than 65536 bytes";
+        case ATTR_RSVD_OPCODE: return "Attribute code uses an opcode reserved for the interpreter";
 
         case FILE_CONTAINS_UNXPTD_DATA: return "class file contains more data than expected, which wasn't processed";
 
@@ -439,40 +650,46 @@ void print_class_file_debug_info(java_class* jc) {
     if (jc->class_name_mismatch)
         printf("Warning: class name and file path don't match.\n");
 
-    if (jc->constant_pool_entries_read != jc->constant_pool_count)
+    if (!jc->reader)
+    {
+        printf("File status code: %d\nStatus description: %s.\n", jc->status, decode_java_class_status(jc->status));
+        return;
+    }
+
+    if (jc->reader->constant_pool_entries_read != jc->constant_pool_count)
     {
-        printf("Failed to read constant pool entry at index #%d\n", jc->constant_pool_entries_read);
+        printf("Failed to read constant pool entry at index #%d\n", jc->reader->constant_pool_entries_read);
     }
-    else if (jc->validity_entries_checked != jc->constant_pool_count)
+    else if (jc->reader->validity_entries_checked != jc->constant_pool_count)
     {
-        printf("Failed to check constant pool validity. Entry at index #%d is not valid.\n", jc->validity_entries_checked);
+        printf("Failed to check constant pool validity. Entry at index #%d is not valid.\n", jc->reader->validity_entries_checked);
     }
-    else if (jc->interface_entries_read != jc->interface_count)
+    else if (jc->reader->interface_entries_read != jc->interface_count)
     {
-        printf("Failed to read interface at index #%d\n", jc->interface_entries_read);
+        printf("Failed to read interface at index #%d\n", jc->reader->interface_entries_read);
     }
-    else if (jc->field_entries_read != jc->field_count)
+    else if (jc->reader->field_entries_read != jc->field_count)
     {
-        printf("Failed to read field at index #%d\n", jc->field_entries_read);
+        printf("Failed to read field at index #%d\n", jc->reader->field_entries_read);
 
-        if (jc->attribute_entries_read != -1)
-            printf("Failed to read its attribute at index %d.\n", jc->attribute_entries_read);
+        if (jc->reader->attribute_entries_read != -1)
+            printf("Failed to read its attribute at index %d.\n", jc->reader->attribute_entries_read);
     }
-    else if (jc->method_entries_read != jc->method_count)
+    else if (jc->reader->method_entries_read != jc->method_count)
     {
-        printf("Failed to read method at index #%d\n", jc->method_entries_read);
+        printf("Failed to read method at index #%d\n", jc->reader->method_entries_read);
 
-        if (jc->attribute_entries_read != -1)
-            printf("Failed to read its attribute at index %d.\n", jc->attribute_entries_read);
+        if (jc->reader->attribute_entries_read != -1)
+            printf("Failed to read its attribute at index %d.\n", jc->reader->attribute_entries_read);
     }
-    else if (jc->attribute_entries_read != jc->attribute_count)
+    else if (jc->reader->attribute_entries_read != jc->attribute_count)
     {
-        printf("Failed to read attribute at index #%d\n", jc->attribute_entries_read);
+        printf("Failed to read attribute at index #%d\n", jc->reader->attribute_entries_read);
 
     }
 
     printf("File status code: %d\nStatus description: %s.\n", jc->status, decode_java_class_status(jc->status));
-    printf("Number of bytes read: %d\n", jc->total_bytes_read);
+    printf("Number of bytes read: %d\n", jc->reader->total_bytes_read);
 }
 
 void print_class_file_info(java_class* jc) {
@@ -2,13 +2,16 @@
 #define JAVACLASSFILE_H
 
 typedef struct java_class java_class;
+struct shared_archive;
 
 #include <stdio.h>
 #include <stdint.h>
+#include "arena.h"
 #include "constantpool.h"
 #include "attributes.h"
 #include "fields.h"
 #include "methods.h"
+#include "verifycache.h"
 
 enum access_flags_types {
     CLASS_ACCESS_TYPE,
@@ -50,6 +53,20 @@ enum access_flags {
 
 };
 
+typedef struct member_index_entry {
+    uint32_t hash;
+    uint16_t index;
+} member_index_entry;
+
+#define MEMBER_HASH(name_hash, descriptor_hash) ((name_hash) * 31 + (descriptor_hash))
+
+enum class_image_source {
+    CLASS_IMAGE_NONE,
+    CLASS_IMAGE_BORROWED,
+    CLASS_IMAGE_MAPPED,
+    CLASS_IMAGE_ALLOCATED
+};
+
 enum java_class_status {
     CLASS_STA_OK,
     CLASS_STA_UNSPTD_VER,
@@ -89,13 +106,30 @@ enum java_class_status {
     ATTR_INV_INNERCLASS_IDXS,
     ATTR_INV_EXC_CLASS_IDX,
     ATTR_INV_CODE_LEN,
+    ATTR_RSVD_OPCODE,
 
     FILE_CONTAINS_UNXPTD_DATA
 };
 
+typedef struct class_reader {
+    uint8_t verified_image;
+    uint32_t total_bytes_read;
+    uint8_t last_tag_read;
+    int32_t constant_pool_entries_read;
+    int32_t interface_entries_read;
+    int32_t field_entries_read;
+    int32_t method_entries_read;
+    int32_t attribute_entries_read;
+    int32_t validity_entries_checked;
+} class_reader;
+
 struct java_class {
-  
-    FILE* file;
+
+    const uint8_t* image;
+    uint32_t image_length;
+    enum class_image_source image_source;
+    const uint8_t* code_image;
+    const char* source_path;
     enum java_class_status status;
     uint8_t class_name_mismatch;
 
@@ -111,24 +145,34 @@ struct java_class {
     field_info* fields;
     uint16_t method_count;
     method_info* methods;
+    member_index_entry* field_index;
+    uint32_t field_index_mask;
+    member_index_entry* method_index;
+    uint32_t method_index_mask;
     uint16_t attribute_count;
     attribute_info* attributes;
 
     uint16_t static_field_count;
-    uint16_t instance_field_count;
+    uint32_t instance_size;
+    uint16_t reference_slot_count;
+    uint16_t* reference_slots;
+    // Set when the layout came from a shared archive and still has to be
+    // checked against the superclass.
+    uint8_t layout_archived;
 
-    uint32_t total_bytes_read;
-    uint8_t last_tag_read;
-    int32_t constant_pool_entries_read;
-    int32_t interface_entries_read;
-    int32_t field_entries_read;
-    int32_t method_entries_read;
-    int32_t attribute_entries_read;
-    int32_t validity_entries_checked;
+    arena memory;
+    class_reader* reader;
 
 };
 
 void open_class_file(java_class *, const char *);
+void open_class_from_memory(java_class *, const uint8_t *, uint32_t, const char *);
+void open_class_from_buffer(java_class *, uint8_t *, uint32_t, const char *);
+void open_verified_class_from_memory(java_class *, const uint8_t *, uint32_t);
+uint8_t open_shared_class(java_class *, struct shared_archive *, const uint8_t *, int32_t);
+void set_class_image_retention(uint8_t);
+void set_class_source(java_class *, const char *);
+void set_class_verification_cache(verification_cache *);
 void close_class_file(java_class *);
 const char* decode_java_class_status(enum java_class_status);
 void decode_access_flags(uint16_t, char *, int32_t, enum access_flags_types);
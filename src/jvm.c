@@ -3,6 +3,8 @@
 #include "utf8.h"
 #include "natives.h"
 #include "instructions.h"
+#include "classprefetch.h"
+#include "gc.h"
 
 const char* get_general_status_msg(enum general_status status)
 {
@@ -18,6 +20,7 @@ const char* get_general_status_msg(enum general_status status)
     case OUT_OF_MEMORY: return "Out of memory";
     case MAIN_METHOD_NOT_FOUND: return "Main method not found";
     case INVALID_INSTRUCTION_PARAMETERS: return "Invalid instruction parameters";
+    case INVALID_METHOD_CODE: return "Method code attribute is invalid";
   }
 
   return "Unknown status";
@@ -28,8 +31,24 @@ void initialize_virtual_machine(interpreter_module* virtual_machine)
     virtual_machine->status = OK;
     virtual_machine->frames = NULL;
     virtual_machine->classes = NULL;
-    virtual_machine->objects = NULL;
+    memset(&virtual_machine->heap, 0, sizeof(gc_heap));
+    set_heap_size(virtual_machine, GC_DEFAULT_HEAP_SIZE);
+    set_pause_target(virtual_machine, GC_DEFAULT_PAUSE_TARGET);
 
+    virtual_machine->class_table = NULL;
+    virtual_machine->class_table_size = 0;
+    virtual_machine->class_count = 0;
+
+    virtual_machine->string_table = NULL;
+    virtual_machine->string_table_size = 0;
+    virtual_machine->string_count = 0;
+
+    virtual_machine->init_symbol = intern_symbol_ascii("<init>");
+    virtual_machine->system_class_symbol = intern_symbol_ascii("java/lang/System");
+
+    virtual_machine->class_path_entries = NULL;
+    virtual_machine->shared_classes = NULL;
+    virtual_machine->prefetcher = NULL;
     virtual_machine->class_path[0] = '\0';
 
     virtual_machine->sys_and_str_classes_simulation = 1;
@@ -37,6 +56,12 @@ void initialize_virtual_machine(interpreter_module* virtual_machine)
 
 void deinitialize_virtual_machine(interpreter_module* virtual_machine)
 {
+    if (virtual_machine->prefetcher)
+    {
+        stop_class_prefetch(virtual_machine->prefetcher);
+        virtual_machine->prefetcher = NULL;
+    }
+
     free_stack_frame(&virtual_machine->frames);
 
     loaded_classes* classnode = virtual_machine->classes;
@@ -55,19 +80,36 @@ void deinitialize_virtual_machine(interpreter_module* virtual_machine)
         free(classtmp);
     }
 
-    reference_table* refnode = virtual_machine->objects;
-    reference_table* reftmp;
+    class_path_entry* entry;
 
-    while (refnode)
+    while (virtual_machine->class_path_entries)
     {
-        reftmp = refnode;
-        refnode = refnode->next;
-        delete_reference(reftmp->obj);
-        free(reftmp);
+        entry = virtual_machine->class_path_entries;
+        virtual_machine->class_path_entries = entry->next;
+        close_class_path_entry(entry);
     }
 
-    virtual_machine->objects = NULL;
+    if (virtual_machine->shared_classes)
+    {
+        close_shared_archive(virtual_machine->shared_classes);
+        virtual_machine->shared_classes = NULL;
+    }
+
+    release_heap(virtual_machine);
+
+    if (virtual_machine->class_table)
+        free(virtual_machine->class_table);
+
+    if (virtual_machine->string_table)
+        free(virtual_machine->string_table);
+
     virtual_machine->classes = NULL;
+    virtual_machine->class_table = NULL;
+    virtual_machine->class_table_size = 0;
+    virtual_machine->class_count = 0;
+    virtual_machine->string_table = NULL;
+    virtual_machine->string_table_size = 0;
+    virtual_machine->string_count = 0;
 }
 
 void interpret_cl(interpreter_module* virtual_machine, loaded_classes* main_class)
@@ -120,11 +162,154 @@ void set_class_path(interpreter_module* virtual_machine, const char* path)
         virtual_machine->class_path[0] = '\0';
 }
 
+#ifdef _WIN32
+#define CLASS_PATH_SEPARATOR ';'
+#else
+#define CLASS_PATH_SEPARATOR ':'
+#endif
+
+uint8_t add_to_class_path(interpreter_module* virtual_machine, const char* paths)
+{
+    class_path_entry** tail = &virtual_machine->class_path_entries;
+    class_path_entry* entry;
+    const char* end;
+    uint8_t success = 1;
+
+    while (*tail)
+        tail = &(*tail)->next;
+
+    while (*paths)
+    {
+        for (end = paths; *end && *end != CLASS_PATH_SEPARATOR; end++);
+
+        if (end > paths)
+        {
+            entry = open_class_path_entry(paths, end - paths);
+
+            if (entry)
+            {
+                *tail = entry;
+                tail = &entry->next;
+            }
+            else
+            {
+                success = 0;
+            }
+        }
+
+        paths = *end ? end + 1 : end;
+    }
+
+    return success;
+}
+
+uint8_t use_shared_archive(interpreter_module* virtual_machine, const char* path)
+{
+    virtual_machine->shared_classes = open_shared_archive(path);
+    return virtual_machine->shared_classes != NULL;
+}
+
+uint8_t dump_shared_archive(interpreter_module* virtual_machine, const char* path)
+{
+    java_class** classes = (java_class**)malloc(sizeof(java_class*) * (virtual_machine->class_count + 1));
+    loaded_classes* node;
+    uint32_t count = 0;
+    uint8_t success;
+
+    if (!classes)
+        return 0;
+
+    for (node = virtual_machine->classes; node; node = node->next)
+    {
+        if (node->jc->image && node->jc->source_path)
+            classes[count++] = node->jc;
+    }
+
+    success = write_shared_archive(path, classes, count);
+    free(classes);
+
+    return success;
+}
+
+// Returns 0 when no class path entry holds the class, leaving jc unopened.
+static uint8_t open_class_from_class_path(interpreter_module* virtual_machine, java_class* jc, const char* class_file_name)
+{
+    class_path_entry* entry;
+    jar_entry* archived;
+    const uint8_t* data;
+    uint8_t* inflated;
+    char path[1024];
+
+    for (entry = virtual_machine->class_path_entries; entry; entry = entry->next)
+    {
+        if (entry->jar)
+        {
+            archived = find_jar_entry(entry->jar, (const uint8_t*)class_file_name, strlen(class_file_name));
+
+            if (!archived || !read_jar_entry(entry->jar, archived, &data, &inflated))
+                continue;
+
+            if (inflated)
+                open_class_from_buffer(jc, inflated, archived->uncompressed_size, class_file_name);
+            else
+                open_class_from_memory(jc, data, archived->uncompressed_size, class_file_name);
+
+            set_class_source(jc, entry->jar_path);
+            return 1;
+        }
+
+        if (!class_path_entry_has_class(entry, class_file_name))
+            continue;
+
+        snprintf(path, sizeof(path), "%s%s", entry->directory, class_file_name);
+        open_class_file(jc, path);
+
+        if (jc->status != CLASS_STA_FILE_CN_BE_OPENED)
+        {
+            set_class_source(jc, path);
+            return 1;
+        }
+
+        close_class_file(jc);
+    }
+
+    return 0;
+}
+
+// The indexed class path entries are consulted first, so a class found
+// there costs one lookup and one open. Only classes none of them holds are
+// probed for in the working directory and next to the main class.
+void open_class_by_name(interpreter_module* virtual_machine, java_class* jc, const uint8_t* className_utf8_bytes, int32_t utf8_length)
+{
+    char path[1024];
+
+    snprintf(path, sizeof(path), "%.*s.class", utf8_length, className_utf8_bytes);
+
+    if (virtual_machine->shared_classes &&
+        open_shared_class(jc, virtual_machine->shared_classes, className_utf8_bytes, utf8_length))
+    {
+        return;
+    }
+
+    if (virtual_machine->class_path_entries && open_class_from_class_path(virtual_machine, jc, path))
+        return;
+
+    open_class_file(jc, path);
+    set_class_source(jc, path);
+
+    if (jc->status == CLASS_STA_FILE_CN_BE_OPENED && virtual_machine->class_path[0])
+    {
+        close_class_file(jc);
+        snprintf(path, sizeof(path), "%s%.*s.class", virtual_machine->class_path, utf8_length, className_utf8_bytes);
+        open_class_file(jc, path);
+        set_class_source(jc, path);
+    }
+}
+
 uint8_t class_handler(interpreter_module* virtual_machine, const uint8_t* className_utf8_bytes, int32_t utf8_length, loaded_classes** output_class)
 {
     java_class* jc;
     constant_pool_info* cpi;
-    char path[1024];
     uint8_t success = 1;
     uint16_t u16;
 
@@ -168,15 +353,12 @@ uint8_t class_handler(interpreter_module* virtual_machine, const uint8_t* classN
     }
 
 
-    snprintf(path, sizeof(path), "%.*s.class", utf8_length, className_utf8_bytes);
+    jc = virtual_machine->prefetcher ? take_prefetched_class(virtual_machine->prefetcher, className_utf8_bytes, utf8_length) : NULL;
 
-    jc = (java_class*)malloc(sizeof(java_class));
-    open_class_file(jc, path);
-
-    if (jc->status == CLASS_STA_FILE_CN_BE_OPENED && virtual_machine->class_path[0])
+    if (!jc)
     {
-        snprintf(path, sizeof(path), "%s%.*s.class", virtual_machine->class_path, utf8_length, className_utf8_bytes);
-        open_class_file(jc, path);
+        jc = (java_class*)malloc(sizeof(java_class));
+        open_class_by_name(virtual_machine, jc, className_utf8_bytes, utf8_length);
     }
 
     if (jc->status != CLASS_STA_OK)
@@ -192,15 +374,14 @@ uint8_t class_handler(interpreter_module* virtual_machine, const uint8_t* classN
             cpi = jc->constant_pool + jc->super_class - 1;
             cpi = jc->constant_pool + cpi->Class.name_index - 1;
             success = class_handler(virtual_machine, UTF8(cpi), &loaded_class);
+        }
 
-            if (success)
-            {
-                jc->instance_field_count += loaded_class->jc->instance_field_count;
-
-                for (u16 = 0; u16 < jc->field_count; u16++)
-                    jc->fields[u16].offset += loaded_class->jc->instance_field_count;
-            }
-
+        // An archived layout holds while the superclass kept its own.
+        if (success && !(jc->layout_archived && (!jc->super_class || loaded_class->jc->layout_archived)))
+        {
+            jc->layout_archived = 0;
+            success = layout_instance_fields(jc, jc->super_class ? loaded_class->jc : NULL) &&
+                      build_reference_slots(jc, jc->super_class ? loaded_class->jc : NULL);
         }
 
         for (u16 = 0; success && u16 < jc->interface_count; u16++)
@@ -217,6 +398,9 @@ uint8_t class_handler(interpreter_module* virtual_machine, const uint8_t* classN
         success = loaded_class != NULL;
     }
 
+    if (success && virtual_machine->prefetcher)
+        prefetch_referenced_classes(virtual_machine->prefetcher, jc);
+
     if (success)
     {
 
@@ -236,13 +420,21 @@ uint8_t class_handler(interpreter_module* virtual_machine, const uint8_t* classN
 
 uint8_t method_handler(interpreter_module* virtual_machine, java_class* jc, constant_pool_info* cp_method, loaded_classes** output_class)
 {
-
     constant_pool_info* cpi;
+    loaded_classes* method_class = NULL;
+
+    if (cp_method->Methodref.resolved)
+    {
+        if (output_class)
+            *output_class = cp_method->Methodref.resolved_class;
+
+        return 1;
+    }
 
     cpi = jc->constant_pool + cp_method->Methodref.class_index - 1;
     cpi = jc->constant_pool + cpi->Class.name_index - 1;
 
-    if (!class_handler(virtual_machine, UTF8(cpi), output_class))
+    if (!class_handler(virtual_machine, UTF8(cpi), &method_class))
         return 0;
 
     cpi = jc->constant_pool + cp_method->Methodref.name_and_type_index - 1;
@@ -279,19 +471,32 @@ uint8_t method_handler(interpreter_module* virtual_machine, java_class* jc, cons
         }
     }
 
+    cp_method->Methodref.resolved = 1;
+    cp_method->Methodref.resolved_class = method_class;
+
+    if (output_class)
+        *output_class = method_class;
+
     return 1;
 }
 
 uint8_t field_handler(interpreter_module* virtual_machine, java_class* jc, constant_pool_info* cp_field, loaded_classes** output_class)
 {
+    constant_pool_info* cpi;
+    loaded_classes* field_class = NULL;
 
+    if (cp_field->Fieldref.resolved)
+    {
+        if (output_class)
+            *output_class = cp_field->Fieldref.resolved_class;
 
-    constant_pool_info* cpi;
+        return 1;
+    }
 
     cpi = jc->constant_pool + cp_field->Fieldref.class_index - 1;
     cpi = jc->constant_pool + cpi->Class.name_index - 1;
 
-    if (!class_handler(virtual_machine, UTF8(cpi), output_class))
+    if (!class_handler(virtual_machine, UTF8(cpi), &field_class))
         return 0;
 
     cpi = jc->constant_pool + cp_field->Fieldref.name_and_type_index - 1;
@@ -312,6 +517,12 @@ uint8_t field_handler(interpreter_module* virtual_machine, java_class* jc, const
             return 0;
     }
 
+    cp_field->Fieldref.resolved = 1;
+    cp_field->Fieldref.resolved_class = field_class;
+
+    if (output_class)
+        *output_class = field_class;
+
     return 1;
 }
 
@@ -319,6 +530,13 @@ uint8_t run_method(interpreter_module* virtual_machine, java_class* jc, method_i
 {
 
     frame* caller_frame = virtual_machine->frames ? virtual_machine->frames->fr : NULL;
+
+    if (!(method->access_flags & NATIVE_ACCESS_FLAG) && !get_method_code(jc, method))
+    {
+        virtual_machine->status = INVALID_METHOD_CODE;
+        return 0;
+    }
+
     frame* fr = create_new_frame(jc, method);
 
 
@@ -330,11 +548,13 @@ uint8_t run_method(interpreter_module* virtual_machine, java_class* jc, method_i
 
     uint8_t parameterIndex;
     int32_t parameter;
+    operand_type parameterType;
 
     for (parameterIndex = 0; parameterIndex < parameters_amount; parameterIndex++)
     {
-        pop_from_stack_operand(&caller_frame->operands, &parameter, NULL);
+        pop_from_stack_operand(&caller_frame->operands, &parameter, &parameterType);
         fr->local_vars[parameters_amount - parameterIndex - 1] = parameter;
+        fr->local_types[parameters_amount - parameterIndex - 1] = parameterType;
     }
 
     if (method->access_flags & NATIVE_ACCESS_FLAG)
@@ -348,7 +568,7 @@ uint8_t run_method(interpreter_module* virtual_machine, java_class* jc, method_i
         native_func native = get_native_func(UTF8(className), UTF8(methodName), UTF8(descriptor));
 
         if (native)
-            native(virtual_machine, fr, UTF8(descriptor));
+            native(virtual_machine, fr, &method->signature);
     }
     else
     {
@@ -356,7 +576,8 @@ uint8_t run_method(interpreter_module* virtual_machine, java_class* jc, method_i
 
         while (fr->PC < fr->bytecode_length)
         {
-
+            if (virtual_machine->heap.collect_requested && !collect_garbage(virtual_machine))
+                return 0;
 
             uint8_t opcode = *(fr->bytecode + fr->PC++);
             function = fetchOpcodeFunction(opcode);
@@ -401,83 +622,59 @@ uint8_t run_method(interpreter_module* virtual_machine, java_class* jc, method_i
     return virtual_machine->status == OK;
 }
 
-uint8_t get_method_descriptor_param_cout(const uint8_t* descriptor_utf8, int32_t utf8_length)
-{
-    uint8_t parameterCount = 0;
-
-    while (utf8_length > 0)
-    {
-        switch (*descriptor_utf8)
-        {
-            case '(': break;
-            case ')': return parameterCount;
-
-            case 'J': case 'D':
-                parameterCount += 2;
-                break;
-
-            case 'L':
-
-                parameterCount++;
-
-                do {
-                    utf8_length--;
-                    descriptor_utf8++;
-                } while (utf8_length > 0 && *descriptor_utf8 != ';');
-
-                break;
-
-            case '[':
+#define CLASS_TABLE_INITIAL_SIZE 64
 
-                parameterCount++;
+static uint8_t grow_class_table(interpreter_module* virtual_machine)
+{
+    uint32_t new_size = virtual_machine->class_table_size ? virtual_machine->class_table_size * 2 : CLASS_TABLE_INITIAL_SIZE;
+    loaded_classes** new_table = (loaded_classes**)calloc(new_size, sizeof(loaded_classes*));
 
-                do {
-                    utf8_length--;
-                    descriptor_utf8++;
-                } while (utf8_length > 0 && *descriptor_utf8 == '[');
-
-                if (utf8_length > 0 && *descriptor_utf8 == 'L')
-                {
-                    do {
-                        utf8_length--;
-                        descriptor_utf8++;
-                    } while (utf8_length > 0 && *descriptor_utf8 != ';');
-                }
+    if (!new_table)
+        return 0;
 
-                break;
+    loaded_classes* node;
 
-            case 'F':
-            case 'B':
-            case 'C':
-            case 'I':
-            case 'S':
-            case 'Z':
-                parameterCount++;
-                break;
+    for (node = virtual_machine->classes; node; node = node->next)
+    {
+        node->hash_next = new_table[node->name->hash & (new_size - 1)];
+        new_table[node->name->hash & (new_size - 1)] = node;
+    }
 
-            default:
-                break;
-        }
+    if (virtual_machine->class_table)
+        free(virtual_machine->class_table);
 
-        descriptor_utf8++;
-        utf8_length--;
-    }
+    virtual_machine->class_table = new_table;
+    virtual_machine->class_table_size = new_size;
 
-    return parameterCount;
+    return 1;
 }
 
 loaded_classes* add_class_to_loaded_classes(interpreter_module* virtual_machine, java_class* jc)
 {
+    if ((virtual_machine->class_count + 1) * 4 > virtual_machine->class_table_size * 3 &&
+        !grow_class_table(virtual_machine))
+    {
+        return NULL;
+    }
+
     loaded_classes* node = (loaded_classes*)malloc(sizeof(loaded_classes));
 
     if (node)
     {
+        constant_pool_info* cpi = jc->constant_pool + jc->this_class - 1;
+        cpi = jc->constant_pool + cpi->Class.name_index - 1;
+
         node->jc = jc;
         node->static_data = NULL;
-        node->needs_init = 1;
+        node->init_state = CLASS_NOT_INITIALIZED;
+        node->statics_remembered = 0;
+        node->name = cpi->Utf8.sym;
         node->next = virtual_machine->classes;
+        node->hash_next = virtual_machine->class_table[node->name->hash & (virtual_machine->class_table_size - 1)];
 
         virtual_machine->classes = node;
+        virtual_machine->class_table[node->name->hash & (virtual_machine->class_table_size - 1)] = node;
+        virtual_machine->class_count++;
     }
 
     return node;
@@ -485,23 +682,20 @@ loaded_classes* add_class_to_loaded_classes(interpreter_module* virtual_machine,
 
 loaded_classes* class_is_already_loaded(interpreter_module* virtual_machine, const uint8_t* utf8_bytes, int32_t utf8_length)
 {
-    loaded_classes* classes = virtual_machine->classes;
-    java_class* jc;
-    constant_pool_info* cpi;
+    return find_loaded_class(virtual_machine, lookup_symbol(utf8_bytes, utf8_length));
+}
 
-    while (classes)
-    {
-        jc = classes->jc;
-        cpi = jc->constant_pool + jc->this_class - 1;
-        cpi = jc->constant_pool + cpi->Class.name_index - 1;
+loaded_classes* find_loaded_class(interpreter_module* virtual_machine, symbol* name)
+{
+    if (!virtual_machine->class_table || !name)
+        return NULL;
 
-        if (compare_utf8(UTF8(cpi), utf8_bytes, utf8_length))
-            return classes;
+    loaded_classes* classes = virtual_machine->class_table[name->hash & (virtual_machine->class_table_size - 1)];
 
-        classes = classes->next;
-    }
+    while (classes && classes->name != name)
+        classes = classes->hash_next;
 
-    return NULL;
+    return classes;
 }
 
 java_class* get_super_class_of_given_class(interpreter_module* virtual_machine, java_class* jc)
@@ -509,10 +703,13 @@ java_class* get_super_class_of_given_class(interpreter_module* virtual_machine,
     loaded_classes* lc;
     constant_pool_info* cp1;
 
+    if (!jc->super_class)
+        return NULL;
+
     cp1 = jc->constant_pool + jc->super_class - 1;
     cp1 = jc->constant_pool + cp1->Class.name_index - 1;
 
-    lc = class_is_already_loaded(virtual_machine, UTF8(cp1));
+    lc = find_loaded_class(virtual_machine, cp1->Utf8.sym);
 
     return lc ? lc->jc : NULL;
 }
@@ -531,10 +728,10 @@ uint8_t is_super_class_of_given_class(interpreter_module* virtual_machine, java_
         cp1 = jc->constant_pool + jc->super_class - 1;
         cp1 = jc->constant_pool + cp1->Class.name_index - 1;
 
-        if (compare_utf8(UTF8(cp1), UTF8(cp2)))
+        if (cp1->Utf8.sym == cp2->Utf8.sym)
             return 1;
 
-        classes = class_is_already_loaded(virtual_machine, UTF8(cp1));
+        classes = find_loaded_class(virtual_machine, cp1->Utf8.sym);
 
         if (classes)
             jc = classes->jc;
@@ -547,17 +744,42 @@ uint8_t is_super_class_of_given_class(interpreter_module* virtual_machine, java_
 
 uint8_t initialize_class(interpreter_module* virtual_machine, loaded_classes* lc)
 {
-    if (lc->needs_init)
-        lc->needs_init = 0;
-    else
-        return 1;
+    switch (lc->init_state)
+    {
+        case CLASS_INITIALIZED:
+        case CLASS_BEING_INITIALIZED:
+            return 1;
+
+        case CLASS_INIT_FAILED:
+            return 0;
+
+        default:
+            break;
+    }
+
+    lc->init_state = CLASS_BEING_INITIALIZED;
+
+    if (lc->jc->super_class)
+    {
+        constant_pool_info* cp = lc->jc->constant_pool + lc->jc->super_class - 1;
+        loaded_classes* super = find_loaded_class(virtual_machine, lc->jc->constant_pool[cp->Class.name_index - 1].Utf8.sym);
+
+        if (super && !initialize_class(virtual_machine, super))
+        {
+            lc->init_state = CLASS_INIT_FAILED;
+            return 0;
+        }
+    }
 
     if (lc->jc->static_field_count > 0)
     {
-        lc->static_data = (int32_t*)malloc(sizeof(int32_t) * lc->jc->static_field_count);
+        lc->static_data = (int32_t*)calloc(lc->jc->static_field_count, sizeof(int32_t));
 
         if (!lc->static_data)
+        {
+            lc->init_state = CLASS_INIT_FAILED;
             return 0;
+        }
 
         uint16_t index;
         attribute_info* att;
@@ -597,7 +819,7 @@ uint8_t initialize_class(interpreter_module* virtual_machine, loaded_classes* lc
 
                 case STRING_CONST:
                     cp = lc->jc->constant_pool + cp->String.string_index - 1;
-                    lc->static_data[field->offset] = (int32_t)create_new_string(virtual_machine, UTF8(cp));
+                    lc->static_data[field->offset] = (int32_t)intern_string(virtual_machine, cp->Utf8.sym);
                     break;
 
                 default:
@@ -609,93 +831,122 @@ uint8_t initialize_class(interpreter_module* virtual_machine, loaded_classes* lc
     method_info* clinit = get_matching_method(lc->jc, (uint8_t*)"<clinit>", 8, (uint8_t*)"()V", 3, STATIC_ACCESS_FLAG);
 
     if (clinit && !run_method(virtual_machine, lc->jc, clinit, 0))
+    {
+        lc->init_state = CLASS_INIT_FAILED;
         return 0;
+    }
 
+    lc->init_state = CLASS_INITIALIZED;
     return 1;
 }
 
 reference* create_new_string(interpreter_module* virtual_machine, const uint8_t* str, int32_t strlen)
 {
-    reference* r = (reference*)malloc(sizeof(reference));
-    reference_table* node = (reference_table*)malloc(sizeof(reference_table));
-
-    if (!node || !r)
-    {
-        if (node) free(node);
-        if (r) free(r);
+    reference* r = allocate_reference(virtual_machine, REF_TYPE_STRING, strlen);
 
+    if (!r)
         return NULL;
-    }
 
-    r->type = REF_TYPE_STRING;
     r->str.len = strlen;
 
     if (strlen)
-    {
-        r->str.utf8_bytes = (uint8_t*)malloc(strlen);
+        memcpy(REFERENCE_PAYLOAD(r), str, strlen);
 
-        if (!r->str.utf8_bytes)
-        {
-            free(r);
-            free(node);
-            return NULL;
-        }
+    return r;
+}
 
-        memcpy(r->str.utf8_bytes, str, strlen);
-    }
-    else
+#define STRING_TABLE_INITIAL_SIZE 256
+
+static uint8_t grow_string_table(interpreter_module* virtual_machine)
+{
+    uint32_t new_size = virtual_machine->string_table_size ? virtual_machine->string_table_size * 2 : STRING_TABLE_INITIAL_SIZE;
+    reference** new_table = (reference**)calloc(new_size, sizeof(reference*));
+
+    if (!new_table)
+        return 0;
+
+    uint32_t index, slot;
+    reference* str;
+
+    for (index = 0; index < virtual_machine->string_table_size; index++)
     {
-        r->str.utf8_bytes = NULL;
+        str = virtual_machine->string_table[index];
+
+        if (!str)
+            continue;
+
+        slot = utf8_hash(STRING_BYTES(str), str->str.len) & (new_size - 1);
+
+        while (new_table[slot])
+            slot = (slot + 1) & (new_size - 1);
+
+        new_table[slot] = str;
     }
 
-    node->next = virtual_machine->objects;
-    node->obj = r;
-    virtual_machine->objects = node;
+    if (virtual_machine->string_table)
+        free(virtual_machine->string_table);
 
+    virtual_machine->string_table = new_table;
+    virtual_machine->string_table_size = new_size;
 
-    return r;
+    return 1;
 }
 
-reference* create_new_class_instance(interpreter_module* virtual_machine, loaded_classes* lc)
+// Equal literals map to the same symbol, so one String per symbol gives
+// them a single identity across classes. It is allocated in the old
+// generation, where it never moves, and shares the symbol's bytes.
+reference* intern_string(interpreter_module* virtual_machine, symbol* sym)
 {
-    if (!initialize_class(virtual_machine, lc))
-        return 0;
+    uint32_t slot;
+    reference* str;
 
-    java_class* jc = lc->jc;
-    reference* r = (reference*)malloc(sizeof(reference));
-    reference_table* node = (reference_table*)malloc(sizeof(reference_table));
-
-    if (!node || !r)
+    if ((virtual_machine->string_count + 1) * 4 > virtual_machine->string_table_size * 3 &&
+        !grow_string_table(virtual_machine))
     {
-        if (node) free(node);
-        if (r) free(r);
-
         return NULL;
     }
 
-    r->type = REF_TYPE_CLASSINSTANCE;
-    r->ci.c = jc;
+    slot = sym->hash & (virtual_machine->string_table_size - 1);
 
-    if (jc->instance_field_count)
+    for (str = virtual_machine->string_table[slot]; str; str = virtual_machine->string_table[slot])
     {
-        r->ci.data = (int32_t*)malloc(sizeof(int32_t) * jc->instance_field_count);
+        if (str->str.constant_bytes == sym->bytes)
+            return str;
 
-        if (!r->ci.data)
-        {
-            free(r);
-            free(node);
-            return NULL;
-        }
-    }
-    else
-    {
-        r->ci.data = NULL;
+        slot = (slot + 1) & (virtual_machine->string_table_size - 1);
     }
 
-    node->next = virtual_machine->objects;
-    node->obj = r;
-    virtual_machine->objects = node;
+    str = allocate_tenured_reference(virtual_machine, REF_TYPE_STRING, 0);
+
+    if (!str)
+        return NULL;
+
+    str->str.len = sym->length;
+    str->str.constant_bytes = sym->bytes;
 
+    virtual_machine->string_table[slot] = str;
+    virtual_machine->string_count++;
+
+    return str;
+}
+
+reference* create_new_class_instance(interpreter_module* virtual_machine, loaded_classes* lc)
+{
+    if (!initialize_class(virtual_machine, lc))
+        return 0;
+
+    return allocate_class_instance(virtual_machine, lc);
+}
+
+reference* allocate_class_instance(interpreter_module* virtual_machine, loaded_classes* lc)
+{
+    java_class* jc = lc->jc;
+    reference* r = allocate_reference(virtual_machine, REF_TYPE_CLASSINSTANCE, jc->instance_size);
+
+    if (!r)
+        return NULL;
+
+    r->ci.c = jc;
 
     return r;
 }
@@ -731,47 +982,17 @@ reference* create_new_array(interpreter_module* virtual_machine, uint32_t length
             return NULL;
     }
 
-    reference* r = (reference*)malloc(sizeof(reference));
-    reference_table* node = (reference_table*)malloc(sizeof(reference_table));
+    if (length > GC_MAX_ARRAY_LENGTH(elementSize, 0))
+        return NULL;
 
-    if (!node || !r)
-    {
-        if (node) free(node);
-        if (r) free(r);
+    reference* r = allocate_reference(virtual_machine, REF_TYPE_ARRAY, elementSize * length);
 
+    if (!r)
         return NULL;
-    }
 
-    r->type = REF_TYPE_ARRAY;
     r->arr.length = length;
     r->arr.type = type;
 
-    if (length > 0)
-    {
-        r->arr.data = (uint8_t*)malloc(elementSize * length);
-
-        if (!r->arr.data)
-        {
-            free(r);
-            free(node);
-            return NULL;
-        }
-
-        uint8_t* data = (uint8_t*)r->arr.data;
-
-        while (length-- > 0)
-            *data++ = 0;
-    }
-    else
-    {
-        r->arr.data = NULL;
-    }
-
-    node->next = virtual_machine->objects;
-    node->obj = r;
-    virtual_machine->objects = node;
-
-
     return r;
 }
 
@@ -794,57 +1015,18 @@ reference* create_new_object_array(interpreter_module* virtual_machine, uint32_t
             break;
     }
 
-    reference* r = (reference*)malloc(sizeof(reference));
-    reference_table* node = (reference_table*)malloc(sizeof(reference_table));
+    if (length > GC_MAX_ARRAY_LENGTH(sizeof(reference*), utf8_length))
+        return NULL;
 
-    if (!node || !r)
-    {
-        if (node) free(node);
-        if (r) free(r);
+    reference* r = allocate_reference(virtual_machine, REF_TYPE_OBJECTARRAY, length * sizeof(reference*) + utf8_length);
 
+    if (!r)
         return NULL;
-    }
 
-    r->type = REF_TYPE_OBJECTARRAY;
     r->oar.length = length;
-    r->oar.utf8_className = (uint8_t*)malloc(utf8_length);
     r->oar.utf8_len = utf8_length;
 
-    if (!r->oar.utf8_className)
-    {
-        free(r);
-        free(node);
-        return NULL;
-    }
-
-    if (length > 0)
-    {
-        r->oar.elements = (reference**)malloc(length * sizeof(reference));
-
-        if (!r->oar.elements)
-        {
-            free(r->oar.utf8_className);
-            free(r);
-            free(node);
-            return NULL;
-        }
-
-        while (length-- > 0)
-            r->oar.elements[length] = NULL;
-
-    }
-    else
-    {
-        r->oar.elements = NULL;
-    }
-
-    while (utf8_length-- > 0)
-        r->oar.utf8_className[utf8_length] = utf8_className[utf8_length];
-
-    node->next = virtual_machine->objects;
-    node->obj = r;
-    virtual_machine->objects = node;
-
+    memcpy(OBJECT_ARRAY_CLASS_NAME(r), utf8_className, utf8_length);
 
     return r;
 }
@@ -858,96 +1040,30 @@ reference* create_new_object_multi_array(interpreter_module* virtual_machine, in
     if (dimensionsSize == 1)
         return create_new_object_array(virtual_machine, dimensions[0], utf8_className, utf8_length);
 
-    if (utf8_length <= 0)
+    if (utf8_length <= 0 || (uint32_t)dimensions[0] > GC_MAX_ARRAY_LENGTH(sizeof(reference*), utf8_length))
         return NULL;
 
-    reference* r = (reference*)malloc(sizeof(reference));
-    reference_table* node = (reference_table*)malloc(sizeof(reference_table));
-
-    if (!node || !r)
-    {
-        if (node) free(node);
-        if (r) free(r);
+    reference* r = allocate_reference(virtual_machine, REF_TYPE_OBJECTARRAY, dimensions[0] * sizeof(reference*) + utf8_length);
 
+    if (!r)
         return NULL;
-    }
 
-    r->type = REF_TYPE_OBJECTARRAY;
     r->oar.length = dimensions[0];
-    r->oar.utf8_className = (uint8_t*)malloc(utf8_length);
     r->oar.utf8_len = utf8_length;
 
-    if (!r->oar.utf8_className)
-    {
-        free(r);
-        free(node);
-        return NULL;
-    }
+    memcpy(OBJECT_ARRAY_CLASS_NAME(r), utf8_className, utf8_length);
 
-    if (dimensions[0] > 0)
+    uint32_t dimensionLength = dimensions[0];
+
+    while (dimensionLength-- > 0)
     {
-        r->oar.elements = (reference**)malloc(dimensions[0] * sizeof(reference));
+        OBJECT_ARRAY_ELEMENTS(r)[dimensionLength] = create_new_object_multi_array(virtual_machine, dimensions + 1, dimensionsSize - 1, utf8_className + 1, utf8_length - 1);
 
-        if (!r->oar.elements)
-        {
-            free(r->oar.utf8_className);
-            free(r);
-            free(node);
+        if (!OBJECT_ARRAY_ELEMENTS(r)[dimensionLength])
             return NULL;
-        }
-
-        uint32_t dimensionLength = dimensions[0];
-
-        while (dimensionLength-- > 0)
-            r->oar.elements[dimensionLength] = create_new_object_multi_array(virtual_machine, dimensions + 1, dimensionsSize - 1, utf8_className + 1, utf8_length - 1);
 
+        remember_reference_store(virtual_machine, r, NULL, OBJECT_ARRAY_ELEMENTS(r)[dimensionLength]);
     }
-    else
-    {
-        r->oar.elements = NULL;
-    }
-
-    memcpy(r->oar.utf8_className, utf8_className, utf8_length);
-
-    node->next = virtual_machine->objects;
-    node->obj = r;
-    virtual_machine->objects = node;
-
 
     return r;
 }
-
-void delete_reference(reference* obj)
-{
-    switch (obj->type)
-    {
-        case REF_TYPE_STRING:
-            if (obj->str.utf8_bytes)
-                free(obj->str.utf8_bytes);
-            break;
-
-        case REF_TYPE_ARRAY:
-            if (obj->arr.data)
-                free(obj->arr.data);
-            break;
-
-        case REF_TYPE_CLASSINSTANCE:
-            if (obj->ci.data)
-                free(obj->ci.data);
-            break;
-
-        case REF_TYPE_OBJECTARRAY:
-        {
-            free(obj->oar.utf8_className);
-
-            if (obj->oar.elements)
-                free(obj->oar.elements);
-            break;
-        }
-
-        default:
-            return;
-    }
-
-    free(obj);
-}
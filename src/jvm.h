@@ -3,11 +3,15 @@
 
 typedef struct interpreter_module interpreter_module;
 typedef struct reference reference;
+typedef struct class_prefetcher class_prefetcher;
+typedef struct gc_workers gc_workers;
 
 #include <stdint.h>
 #include "javaclass.h"
 #include "opcodes.h"
 #include "framestack.h"
+#include "classpath.h"
+#include "sharedarchive.h"
 
 enum general_status {
     OK,
@@ -19,7 +23,8 @@ enum general_status {
     UNKNOWN_INSTRUCTION,
     OUT_OF_MEMORY,
     MAIN_METHOD_NOT_FOUND,
-    INVALID_INSTRUCTION_PARAMETERS
+    INVALID_INSTRUCTION_PARAMETERS,
+    INVALID_METHOD_CODE
 };
 
 const char* get_general_status_msg(enum general_status status);
@@ -27,70 +32,178 @@ const char* get_general_status_msg(enum general_status status);
 typedef struct class_instance
 {
     java_class* c;
-    int32_t* data;
 } class_instance;
 
+// String literals borrow the bytes of their interned symbol instead of
+// carrying a copy after the header.
 typedef struct String
 {
-    uint8_t* utf8_bytes;
     uint32_t len;
+    const uint8_t* constant_bytes;
 } String;
 
 typedef struct Array
 {
     uint32_t length;
-    uint8_t* data;
     opcode_newarray_type type;
 } Array;
 
+// The element class name is stored after the elements.
 typedef struct ObjectArray
 {
     uint32_t length;
-    uint8_t* utf8_className;
     int32_t utf8_len;
-    reference** elements;
 } ObjectArray;
 
 typedef enum reference_type {
      REF_TYPE_ARRAY,
      REF_TYPE_CLASSINSTANCE,
      REF_TYPE_OBJECTARRAY,
-     REF_TYPE_STRING
+     REF_TYPE_STRING,
+     REF_TYPE_FREE
 } reference_type;
 
+// Unused space in the old generation, laid out like an object so that a heap
+// walk can step over it.
+typedef struct free_chunk
+{
+    uint32_t size;
+    reference* next;
+} free_chunk;
+
 struct reference
 {
     reference_type type;
+    uint8_t marked;
+    uint8_t remembered;
+    uint8_t forwarded;
 
     union {
+        reference* forwardee;
         class_instance ci;
         Array arr;
         ObjectArray oar;
         String str;
+        free_chunk chunk;
     };
 };
 
-typedef struct reference_table
-{
-    reference* obj;
-    struct reference_table* next;
-} reference_table;
+// Fields, elements and string bytes follow the header in the same block,
+// which is a multiple of 8 bytes long.
+#define REFERENCE_PAYLOAD(obj) ((uint8_t*)((obj) + 1))
+#define INSTANCE_FIELDS(obj) REFERENCE_PAYLOAD(obj)
+#define ARRAY_ELEMENTS(obj) REFERENCE_PAYLOAD(obj)
+#define OBJECT_ARRAY_ELEMENTS(obj) ((reference**)REFERENCE_PAYLOAD(obj))
+#define OBJECT_ARRAY_CLASS_NAME(obj) (REFERENCE_PAYLOAD(obj) + (obj)->oar.length * sizeof(reference*))
+#define STRING_BYTES(obj) ((obj)->str.constant_bytes ? (obj)->str.constant_bytes : REFERENCE_PAYLOAD(obj))
+
+// A class being initialized is treated as initialized by the thread running
+// its <clinit>, but instructions are only quickened once it has finished.
+typedef enum class_init_state {
+    CLASS_NOT_INITIALIZED,
+    CLASS_BEING_INITIALIZED,
+    CLASS_INITIALIZED,
+    CLASS_INIT_FAILED
+} class_init_state;
 
 typedef struct loaded_classes
 {
     java_class* jc;
-    uint8_t needs_init;
+    uint8_t init_state;
+    uint8_t statics_remembered;
     int32_t* static_data;
+    symbol* name;
     struct loaded_classes* next;
+    struct loaded_classes* hash_next;
 } loaded_classes;
 
+typedef struct reference_list
+{
+    reference** entries;
+    uint32_t count;
+    uint32_t capacity;
+} reference_list;
+
+typedef enum gc_phase {
+    GC_IDLE,
+    GC_MARKING,
+    GC_SWEEPING
+} gc_phase;
+
+#define GC_PAUSE_BUCKETS 25
+#define GC_FREE_LISTS 64
+
+// A block of the old generation. Objects and free chunks are placed back to
+// back from the end of this header up to top.
+typedef struct gc_region
+{
+    struct gc_region* next;
+    uint8_t* top;
+    uint8_t* end;
+} gc_region;
+
+// New objects are bump-allocated in the nursery. Survivors of a minor
+// collection are promoted to the old generation, which is bump-allocated in
+// regions, reuses swept space through size-segregated free lists and is
+// collected by mark-sweep.
+typedef struct gc_heap
+{
+    uint32_t size;
+    uint32_t used;
+    uint32_t threshold;
+
+    uint8_t* nursery;
+    uint8_t* nursery_top;
+    uint8_t* nursery_end;
+
+    gc_region* regions;
+    gc_region* allocation_region;
+    reference* free_lists[GC_FREE_LISTS];
+
+    // Old objects that may point into the nursery. Each object carries its
+    // own card, so an object is listed at most once.
+    reference_list remembered;
+    uint8_t remembered_overflow;
+    uint8_t nursery_full;
+
+    // The old generation is marked and swept a few steps at a time, each
+    // one bounded by pause_target microseconds.
+    uint8_t phase;
+    reference_list mark_stack;
+    uint8_t mark_overflow;
+    gc_region* sweep_regions;
+    uint32_t step_allocated;
+    uint32_t pause_target;
+
+    // Helper threads that mark and sweep alongside the interpreter thread.
+    gc_workers* workers;
+
+    // Pause counts by the bit length of their duration in microseconds.
+    uint32_t pause_counts[GC_PAUSE_BUCKETS];
+    uint32_t pause_max;
+    uint64_t pause_total;
+
+    uint8_t collect_requested;
+} gc_heap;
+
 struct interpreter_module
 {
     uint8_t status;
     uint8_t sys_and_str_classes_simulation;
-    reference_table* objects;
+    gc_heap heap;
     stack_frame* frames;
     loaded_classes* classes;
+    loaded_classes** class_table;
+    uint32_t class_table_size;
+    uint32_t class_count;
+    reference** string_table;
+    uint32_t string_table_size;
+    uint32_t string_count;
+    symbol* init_symbol;
+    symbol* system_class_symbol;
+    class_path_entry* class_path_entries;
+    shared_archive* shared_classes;
+    class_prefetcher* prefetcher;
     char class_path[256];
 };
 
@@ -98,6 +211,11 @@ void initialize_virtual_machine(interpreter_module*);
 void deinitialize_virtual_machine(interpreter_module*);
 void interpret_cl(interpreter_module*, loaded_classes*);
 void set_class_path(interpreter_module*, const char*);
+uint8_t add_to_class_path(interpreter_module*, const char*);
+uint8_t use_shared_archive(interpreter_module*, const char*);
+uint8_t dump_shared_archive(interpreter_module*, const char*);
+void open_class_by_name(interpreter_module*, java_class*, const uint8_t*,
+        int32_t);
 uint8_t class_handler(interpreter_module*, const uint8_t*, int32_t,
         loaded_classes**);
 uint8_t method_handler(interpreter_module*, java_class*, constant_pool_info*,
@@ -105,16 +223,18 @@ uint8_t method_handler(interpreter_module*, java_class*, constant_pool_info*,
 uint8_t field_handler(interpreter_module*, java_class*, constant_pool_info*,
         loaded_classes**);
 uint8_t run_method(interpreter_module*, java_class*, method_info*, uint8_t);
-uint8_t get_method_descriptor_param_cout(const uint8_t*, int32_t);
 loaded_classes* add_class_to_loaded_classes(interpreter_module*, java_class*);
 loaded_classes* class_is_already_loaded(interpreter_module*, const uint8_t*,
         int32_t);
+loaded_classes* find_loaded_class(interpreter_module*, symbol*);
 java_class* get_super_class_of_given_class(interpreter_module*, java_class*);
 uint8_t is_super_class_of_given_class(interpreter_module*, java_class*,
         java_class*);
 uint8_t initialize_class(interpreter_module*, loaded_classes*);
 reference* create_new_string(interpreter_module*, const uint8_t*, int32_t);
+reference* intern_string(interpreter_module*, symbol*);
 reference* create_new_class_instance(interpreter_module*, loaded_classes*);
+reference* allocate_class_instance(interpreter_module*, loaded_classes*);
 reference* create_new_array(interpreter_module*, uint32_t,
         opcode_newarray_type);
 reference* create_new_object_array(interpreter_module*, uint32_t,
@@ -122,7 +242,6 @@ reference* create_new_object_array(interpreter_module*, uint32_t,
 reference* create_new_object_multi_array(interpreter_module*, int32_t*,
         uint8_t, const uint8_t*, int32_t);
 
-void delete_reference(reference* obj);
 
  #define DEBUG_REPORT_ERROR_INSTRUCTION \
     printf("\nAbortion request by instruction at %s:%u.\n", __FILE__, __LINE__); \
@@ -1,8 +1,13 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include "javaclass.h"
 #include "jvm.h"
+#include "classprefetch.h"
+#include "gc.h"
+
+#define DEFAULT_SHARED_ARCHIVE "classes.jsa"
 
 int main(int argc, char* args[])
 {
@@ -13,6 +18,17 @@ int main(int argc, char* args[])
         printf(" -c \t Shows the content of the .class file\n");
         printf(" -e \t Execute the method 'main' from the class\n");
         printf(" -b \t Adds UTF-8 BOM to the output\n");
+        printf(" -cp <paths> \t Also looks up classes in the listed directories and .jar files\n");
+        printf(" -jar <file> \t Same as -cp with a single .jar file\n");
+        printf(" -Xshare:dump \t Loads the class (and runs it with -e), then archives every loaded class\n");
+        printf(" -Xshare:on \t Loads classes from the shared archive when available\n");
+        printf(" -XX:SharedArchiveFile=<file> \t Shared archive location (default: %s)\n", DEFAULT_SHARED_ARCHIVE);
+        printf(" -Xverifycache:<file> \t Skips checks for class files verified by an earlier run, recorded in <file>\n");
+        printf(" -Xprefetch:<n> \t Number of threads parsing referenced classes in background (0 disables)\n");
+        printf(" -Xmx<size>[k|m|g] \t Maximum heap size (default: %dm)\n", GC_DEFAULT_HEAP_SIZE >> 20);
+        printf(" -XX:MaxGCPauseMillis=<n> \t Time limit for each step of an old generation collection (default: %d)\n", GC_DEFAULT_PAUSE_TARGET);
+        printf(" -XX:ParallelGCThreads=<n> \t Threads marking and sweeping the old generation (default: %u)\n", get_default_gc_thread_count());
+        printf(" -verbose:gc \t Prints a histogram of garbage collection pauses at exit\n");
         return 0;
     }
 
@@ -43,6 +59,16 @@ int main(int argc, char* args[])
     uint8_t printClassContent = 0;
     uint8_t executeClassMain = 0;
     uint8_t includeBOM = 0;
+    uint8_t dumpSharedArchive = 0;
+    uint8_t useSharedArchive = 0;
+    const char* sharedArchivePath = DEFAULT_SHARED_ARCHIVE;
+    uint32_t prefetchThreads = get_default_prefetch_thread_count();
+    const char* verificationCachePath = NULL;
+    uint32_t heapSize = GC_DEFAULT_HEAP_SIZE;
+    uint32_t pauseTarget = GC_DEFAULT_PAUSE_TARGET;
+    uint8_t printGCPauses = 0;
+    uint32_t gcThreads = get_default_gc_thread_count();
+    char* sizeSuffix;
 
     int argIndex;
 
@@ -54,11 +80,64 @@ int main(int argc, char* args[])
             executeClassMain = 1;
         else if (!strcmp(args[argIndex], "-b"))
             includeBOM = 1;
+        else if ((!strcmp(args[argIndex], "-cp") || !strcmp(args[argIndex], "-jar")) && argIndex + 1 < argc)
+            argIndex++;
+        else if (!strcmp(args[argIndex], "-Xshare:dump"))
+            dumpSharedArchive = 1;
+        else if (!strcmp(args[argIndex], "-Xshare:on"))
+            useSharedArchive = 1;
+        else if (!strncmp(args[argIndex], "-XX:SharedArchiveFile=", 22))
+            sharedArchivePath = args[argIndex] + 22;
+        else if (!strncmp(args[argIndex], "-Xprefetch:", 11))
+            prefetchThreads = (uint32_t)strtoul(args[argIndex] + 11, NULL, 10);
+        else if (!strncmp(args[argIndex], "-Xverifycache:", 14))
+            verificationCachePath = args[argIndex] + 14;
+        else if (!strncmp(args[argIndex], "-XX:MaxGCPauseMillis=", 21))
+            pauseTarget = (uint32_t)strtoul(args[argIndex] + 21, NULL, 10);
+        else if (!strncmp(args[argIndex], "-XX:ParallelGCThreads=", 22))
+            gcThreads = (uint32_t)strtoul(args[argIndex] + 22, NULL, 10);
+        else if (!strcmp(args[argIndex], "-verbose:gc"))
+            printGCPauses = 1;
+        else if (!strncmp(args[argIndex], "-Xmx", 4))
+        {
+            const char* sizeText = args[argIndex] + 4;
+            unsigned long long requestedSize = 0;
+            uint8_t sizeShift = 0;
+
+            if (*sizeText >= '0' && *sizeText <= '9')
+                requestedSize = strtoull(sizeText, &sizeSuffix, 10);
+            else
+                sizeSuffix = (char*)sizeText;
+
+            if (*sizeSuffix == 'k' || *sizeSuffix == 'K')
+                sizeShift = 10;
+            else if (*sizeSuffix == 'm' || *sizeSuffix == 'M')
+                sizeShift = 20;
+            else if (*sizeSuffix == 'g' || *sizeSuffix == 'G')
+                sizeShift = 30;
+
+            if (sizeShift)
+                sizeSuffix++;
+
+            if (sizeSuffix == sizeText || *sizeSuffix || requestedSize == 0)
+            {
+                printf("Invalid heap size '%s', using %um\n", args[argIndex], heapSize >> 20);
+            }
+            else if (requestedSize > (UINT32_MAX >> sizeShift))
+            {
+                heapSize = UINT32_MAX;
+                printf("Heap size '%s' exceeds what the VM can address, using %um\n", args[argIndex], heapSize >> 20);
+            }
+            else
+            {
+                heapSize = (uint32_t)(requestedSize << sizeShift);
+            }
+        }
         else
             printf("Unknown argument #%d ('%s')\n", argIndex, args[argIndex]);
     }
 
-    if (!printClassContent && !executeClassMain)
+    if (!printClassContent && !executeClassMain && !dumpSharedArchive)
     {
         printf("Nothing to do with input.\n");
         printf("Ensure that at least one of the following options are included: \"-c\", \"-e\".\n");
@@ -80,7 +159,7 @@ int main(int argc, char* args[])
         close_class_file(&jc);
     }
 
-    if (executeClassMain)
+    if (executeClassMain || dumpSharedArchive)
     {
         interpreter_module jvm;
         initialize_virtual_machine(&jvm);
@@ -97,9 +176,38 @@ int main(int argc, char* args[])
 
         set_class_path(&jvm, args[1]);
 
-        if (class_handler(&jvm, (const uint8_t*)args[1], inputLength, &mainLoadedClass))
+        for (argIndex = 2; argIndex < argc; argIndex++)
+        {
+            if ((!strcmp(args[argIndex], "-cp") || !strcmp(args[argIndex], "-jar")) && argIndex + 1 < argc)
+            {
+                argIndex++;
+
+                if (!add_to_class_path(&jvm, args[argIndex]))
+                    printf("Could not open every class path entry in '%s'\n", args[argIndex]);
+            }
+        }
+
+        set_lazy_code_attributes(1);
+
+        verification_cache* verificationCache = verificationCachePath ? open_verification_cache(verificationCachePath) : NULL;
+        set_class_verification_cache(verificationCache);
+
+        if (dumpSharedArchive)
+            set_class_image_retention(1);
+        else if (useSharedArchive && !use_shared_archive(&jvm, sharedArchivePath))
+            printf("Could not map shared archive '%s', loading classes from files\n", sharedArchivePath);
+
+        jvm.prefetcher = start_class_prefetch(&jvm, prefetchThreads);
+        set_heap_size(&jvm, heapSize);
+        set_pause_target(&jvm, pauseTarget);
+        set_gc_threads(&jvm, gcThreads);
+
+        if (class_handler(&jvm, (const uint8_t*)args[1], inputLength, &mainLoadedClass) && executeClassMain)
             interpret_cl(&jvm, mainLoadedClass);
 
+        if (dumpSharedArchive && !dump_shared_archive(&jvm, sharedArchivePath))
+            printf("Could not write shared archive '%s'\n", sharedArchivePath);
+
         uint8_t printStatus = jvm.status != OK;
 
 
@@ -109,9 +217,22 @@ int main(int argc, char* args[])
             printf("Status message: %s.", get_general_status_msg(jvm.status));
         }
 
+        if (printGCPauses)
+            print_gc_pauses(&jvm);
+
         deinitialize_virtual_machine(&jvm);
+
+        if (verificationCache)
+        {
+            set_class_verification_cache(NULL);
+
+            if (!close_verification_cache(verificationCache))
+                printf("Could not write verification cache '%s'\n", verificationCachePath);
+        }
     }
 
+    free_symbol_table();
+
     return 0;
 }
 
@@ -0,0 +1,96 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include "mappedfile.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static uint8_t read_whole_file(const char* path, const uint8_t** image, uint32_t* length)
+{
+    FILE* file = fopen(path, "rb");
+    uint8_t* buffer;
+    long size;
+
+    if (!file)
+        return 0;
+
+    if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0 ||
+        (unsigned long)size > UINT32_MAX || fseek(file, 0, SEEK_SET) != 0)
+    {
+        fclose(file);
+        return 0;
+    }
+
+    buffer = (uint8_t*)malloc(size > 0 ? size : 1);
+
+    if (!buffer || fread(buffer, sizeof(uint8_t), size, file) != (size_t)size)
+    {
+        if (buffer)
+            free(buffer);
+
+        fclose(file);
+        return 0;
+    }
+
+    fclose(file);
+
+    *image = buffer;
+    *length = (uint32_t)size;
+
+    return 1;
+}
+
+uint8_t map_file(const char* path, const uint8_t** image, uint32_t* length, uint8_t* mapped)
+{
+#ifndef _WIN32
+    struct stat file_info;
+    void* address;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+        return 0;
+
+    if (fstat(fd, &file_info) == 0 && S_ISREG(file_info.st_mode) &&
+        file_info.st_size > 0 && (uint64_t)file_info.st_size <= UINT32_MAX)
+    {
+        address = mmap(NULL, file_info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+        if (address != MAP_FAILED)
+        {
+            close(fd);
+
+            *image = (const uint8_t*)address;
+            *length = (uint32_t)file_info.st_size;
+            *mapped = 1;
+
+            return 1;
+        }
+    }
+
+    close(fd);
+#endif
+
+    *mapped = 0;
+
+    return read_whole_file(path, image, length);
+}
+
+void unmap_file(const uint8_t* image, uint32_t length, uint8_t mapped)
+{
+    if (!image)
+        return;
+
+#ifndef _WIN32
+    if (mapped)
+    {
+        munmap((void*)image, length);
+        return;
+    }
+#endif
+
+    free((void*)image);
+}
@@ -0,0 +1,9 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <stdint.h>
+
+uint8_t map_file(const char*, const uint8_t**, uint32_t*, uint8_t*);
+void unmap_file(const uint8_t*, uint32_t, uint8_t);
+
+#endif
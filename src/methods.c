@@ -8,7 +8,9 @@
 char read_method(java_class* jc, method_info* entry)
 {
     entry->attributes = NULL;
-    jc->attribute_entries_read = -1;
+    entry->code = NULL;
+    entry->max_stack = entry->max_locals = 0;
+    jc->reader->attribute_entries_read = -1;
 
     if (!read_2_byte_unsigned(jc, &entry->access_flags) || !read_2_byte_unsigned(jc, &entry->name_index) || !read_2_byte_unsigned(jc, &entry->descriptor_index) || !read_2_byte_unsigned(jc, &entry->attributes_count))
     {
@@ -16,12 +18,12 @@ char read_method(java_class* jc, method_info* entry)
         return 0;
     }
 
-    if (!check_access_flags_method(jc, entry->access_flags))
+    if (!jc->reader->verified_image && !check_access_flags_method(jc, entry->access_flags))
         return 0;
 
     if (entry->name_index == 0 ||
         entry->name_index >= jc->constant_pool_count ||
-        !method_name_idx_is_valid(jc, entry->name_index))
+        (!jc->reader->verified_image && !method_name_idx_is_valid(jc, entry->name_index)))
     {
         jc->status = INV_NAME_IDX;
         return 0;
@@ -32,7 +34,7 @@ char read_method(java_class* jc, method_info* entry)
     if (entry->descriptor_index == 0 ||
         entry->descriptor_index >= jc->constant_pool_count ||
         cpi->tag != UTF8_CONST ||
-        cpi->Utf8.length != read_method_descriptor(cpi->Utf8.bytes, cpi->Utf8.length, 1))
+        (!jc->reader->verified_image && cpi->Utf8.length != read_method_descriptor(cpi->Utf8.bytes, cpi->Utf8.length, 1)))
     {
         jc->status = INV_FIELD_DESC_IDX;
         return 0;
@@ -40,7 +42,7 @@ char read_method(java_class* jc, method_info* entry)
 
     if (entry->attributes_count > 0)
     {
-        entry->attributes = (attribute_info*)malloc(sizeof(attribute_info) * entry->attributes_count);
+        entry->attributes = (attribute_info*)allocate_from_arena(&jc->memory, sizeof(attribute_info) * entry->attributes_count);
 
         if (!entry->attributes)
         {
@@ -50,7 +52,7 @@ char read_method(java_class* jc, method_info* entry)
 
         uint16_t i;
 
-        jc->attribute_entries_read = 0;
+        jc->reader->attribute_entries_read = 0;
 
         for (i = 0; i < entry->attributes_count; i++)
         {
@@ -60,27 +62,20 @@ char read_method(java_class* jc, method_info* entry)
                 return 0;
             }
 
-            jc->attribute_entries_read++;
+            jc->reader->attribute_entries_read++;
         }
-    }
-
-    return 1;
-}
-
-void free_method_attributes(method_info* entry)
-{
-    uint32_t i;
 
-    if (entry->attributes != NULL)
-    {
-        for (i = 0; i < entry->attributes_count; i++)
-            free_attribute_info(entry->attributes + i);
-
-        free(entry->attributes);
+        attribute_info* code_attribute = get_attribute_using_type(entry->attributes, entry->attributes_count, ATTRIBUTE_Code);
 
-        entry->attributes_count = 0;
-        entry->attributes = NULL;
+        if (code_attribute)
+        {
+            entry->code = (attr_code_info*)code_attribute->info;
+            entry->max_stack = entry->code->max_stack;
+            entry->max_locals = entry->code->max_locals;
+        }
     }
+
+    return read_method_signature(jc, UTF8(cpi), &entry->signature);
 }
 
 void methods_print(java_class* jc)
@@ -132,29 +127,89 @@ void methods_print(java_class* jc)
     }
 }
 
-method_info* get_matching_method(java_class* jc, const uint8_t* name, int32_t name_len, const uint8_t* descriptor, int32_t descriptor_len, uint16_t flag_mask)
+uint8_t build_method_index(java_class* jc)
 {
-    method_info* method = jc->methods;
-    constant_pool_info* cpi;
+    uint32_t size = 4;
     uint16_t index;
+    method_info* method;
+    constant_pool_info* name;
+    constant_pool_info* descriptor;
+
+    if (jc->method_count == 0)
+        return 1;
 
-    for (index = jc->method_count; index > 0; index--, method++)
+    while (size < (uint32_t)jc->method_count * 2)
+        size <<= 1;
+
+    jc->method_index = (member_index_entry*)allocate_zeroed_from_arena(&jc->memory, size * sizeof(member_index_entry));
+
+    if (!jc->method_index)
+        return 0;
+
+    jc->method_index_mask = size - 1;
+
+    for (index = 0; index < jc->method_count; index++)
     {
-        if ((method->access_flags & flag_mask) != flag_mask)
-            continue;
+        method = jc->methods + index;
+        name = jc->constant_pool + method->name_index - 1;
+        descriptor = jc->constant_pool + method->descriptor_index - 1;
 
-        cpi = jc->constant_pool + method->name_index - 1;
-        if (!compare_ascii_utf8(cpi->Utf8.bytes, cpi->Utf8.length, name, name_len))
-            continue;
+        uint32_t hash = MEMBER_HASH(name->Utf8.sym->hash, descriptor->Utf8.sym->hash);
+        uint32_t slot = hash & jc->method_index_mask;
 
-        cpi = jc->constant_pool + method->descriptor_index - 1;
-        
-        if (!compare_ascii_utf8(cpi->Utf8.bytes, cpi->Utf8.length, descriptor, descriptor_len))
-            continue;
+        while (jc->method_index[slot].index)
+            slot = (slot + 1) & jc->method_index_mask;
 
+        jc->method_index[slot].hash = hash;
+        jc->method_index[slot].index = index + 1;
+    }
 
-        return method;
+    return 1;
+}
+
+static method_info* find_method(java_class* jc, symbol* name, symbol* descriptor, uint16_t flag_mask)
+{
+    if (!jc->method_index || !name || !descriptor)
+        return NULL;
+
+    uint32_t hash = MEMBER_HASH(name->hash, descriptor->hash);
+    uint32_t slot = hash & jc->method_index_mask;
+    member_index_entry* entry;
+    method_info* method;
+
+    for (entry = jc->method_index + slot; entry->index; entry = jc->method_index + slot)
+    {
+        if (entry->hash == hash)
+        {
+            method = jc->methods + entry->index - 1;
+
+            if (jc->constant_pool[method->name_index - 1].Utf8.sym == name &&
+                jc->constant_pool[method->descriptor_index - 1].Utf8.sym == descriptor)
+            {
+                return (method->access_flags & flag_mask) == flag_mask ? method : NULL;
+            }
+        }
+
+        slot = (slot + 1) & jc->method_index_mask;
     }
 
     return NULL;
 }
+
+method_info* get_matching_method(java_class* jc, const uint8_t* name, int32_t name_len, const uint8_t* descriptor, int32_t descriptor_len, uint16_t flag_mask)
+{
+    return find_method(jc, lookup_symbol(name, name_len), lookup_symbol(descriptor, descriptor_len), flag_mask);
+}
+
+method_info* get_method_by_name_and_type(java_class* jc, constant_pool_info* name, constant_pool_info* descriptor, uint16_t flag_mask)
+{
+    return find_method(jc, name->Utf8.sym, descriptor->Utf8.sym, flag_mask);
+}
+
+attr_code_info* get_method_code(java_class* jc, method_info* method)
+{
+    if (!method->code || !decode_code_attribute(jc, method->code))
+        return NULL;
+
+    return method->code;
+}
@@ -13,13 +13,21 @@ struct method_info {
     uint16_t access_flags;
     uint16_t attributes_count;
     attribute_info* attributes;
+
+    method_signature signature;
+    attr_code_info* code;
+    uint16_t max_stack;
+    uint16_t max_locals;
 };
 
 char read_method(java_class*, method_info*);
-void free_method_attributes(method_info*);
 void methods_print(java_class*);
+uint8_t build_method_index(java_class*);
 
 method_info* get_matching_method(java_class*, const uint8_t*, int32_t,
         const uint8_t*, int32_t, uint16_t);
+method_info* get_method_by_name_and_type(java_class*, constant_pool_info*,
+        constant_pool_info*, uint16_t);
+attr_code_info* get_method_code(java_class*, method_info*);
 
 #endif
@@ -9,18 +9,20 @@
 #define HI_WORD(x) (((int32_t)(x >> 32)))
 #define LO_WORD(x) (((int32_t)(x & 0xFFFFFFFFll)))
 
-uint8_t native_println(interpreter_module* jvm, frame* fr, const uint8_t* descriptor_utf8, int32_t length_utf8)
+uint8_t native_println(interpreter_module* jvm, frame* fr, const method_signature* signature)
 {
     int64_t long_value = 0;
     int32_t high, low;
 
-    if (length_utf8 <=1 )
+    if (!signature)
     {
         DEBUG_REPORT_ERROR_INSTRUCTION
         return 0;
     }
 
-    switch (descriptor_utf8[1])
+    uint8_t kind = signature->argument_count > 0 ? signature->argument_kinds[0] : ')';
+
+    switch (kind)
     {
         case ')': break;
 
@@ -49,7 +51,7 @@ uint8_t native_println(interpreter_module* jvm, frame* fr, const uint8_t* descri
             long_value = high;
             long_value = (long_value << 32) | (uint32_t)low;
 
-            if (descriptor_utf8[1] == 'D')
+            if (kind == 'D')
                 printf("%#f", get_double_from_uint64(long_value));
             else
                 printf("%" PRId64"", long_value);
@@ -73,7 +75,7 @@ uint8_t native_println(interpreter_module* jvm, frame* fr, const uint8_t* descri
 
             if (obj->type == REF_TYPE_STRING)
             {
-                uint8_t* bytes = obj->str.utf8_bytes;
+                const uint8_t* bytes = STRING_BYTES(obj);
                 int32_t len = obj->str.len;
 
                 if (len > 0)
@@ -102,7 +104,7 @@ uint8_t native_println(interpreter_module* jvm, frame* fr, const uint8_t* descri
     return 1;
 }
 
-uint8_t native_currentTimeMillis(interpreter_module* jvm, frame* fr, const uint8_t* descriptor_utf8, int32_t length_utf8)
+uint8_t native_currentTimeMillis(interpreter_module* jvm, frame* fr, const method_signature* signature)
 {
     int64_t seconds = (int64_t)time(NULL) * 1000;
 
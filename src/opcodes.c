@@ -56,8 +56,9 @@ const char* get_opcode_mnemonic(uint8_t given_opcode)
         "getfield", "putfield", "invokevirtual", "invokespecial", "invokestatic", "invokeinterface",
         "invokedynamic", "new", "newarray", "anewarray", "arraylength", "athrow",
         "checkcast", "instanceof", "monitorenter", "monitorexit", "wide", "multianewarray",
-        "ifnull", "ifnonnull", "goto_w", "jsr_w", "breakpoint", NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-        NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+        "ifnull", "ifnonnull", "goto_w", "jsr_w", "breakpoint", "getstatic_quick", "putstatic_quick", "getfield_quick", "putfield_quick",
+        "invokevirtual_quick", "invokespecial_quick", "invokestatic_quick", "invokeinterface_quick", "new_quick",
+        NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
         NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
         NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, "impdep1", "impdep2"
     };
@@ -34,7 +34,15 @@ enum opcodes {
     opcode_invokedynamic, opcode_new, opcode_newarray, opcode_anewarray, opcode_arraylength, opcode_athrow,
     opcode_checkcast, opcode_instanceof, opcode_monitorenter, opcode_monitorexit, opcode_wide, opcode_multianewarray,
     opcode_ifnull, opcode_ifnonnull, opcode_goto_w,opcode_jsr_w,
-    opcode_breakpoint = 0xCA, opcode_impdep1 = 0xFE, opcode_impdep2
+    opcode_breakpoint = 0xCA,
+
+    // Internal forms that resolved instructions are rewritten to once the
+    // class they refer to has been initialized.
+    opcode_getstatic_quick, opcode_putstatic_quick, opcode_getfield_quick, opcode_putfield_quick,
+    opcode_invokevirtual_quick, opcode_invokespecial_quick, opcode_invokestatic_quick,
+    opcode_invokeinterface_quick, opcode_new_quick,
+
+    opcode_impdep1 = 0xFE, opcode_impdep2
 };
 
 typedef enum opcode_newarray_type {
@@ -1,46 +1,61 @@
 #include <math.h>
+#include <string.h>
 #include "readfunctions.h"
 #include "utf8.h"
 #include "validity.h"
 
-static const union {
-    uint16_t value;
-    uint8_t bytes[2];
-} byte_order = {1};
-#define LITTLE_ENDIAN_CONVENTION byte_order.bytes[1]
+uint8_t read_1_byte_unsigned(java_class* jc, uint8_t* resultant_value)
+{
+    if (jc->image_length - jc->reader->total_bytes_read < 1)
+        return 0;
+
+    if (resultant_value)
+        *resultant_value = jc->image[jc->reader->total_bytes_read];
+
+    jc->reader->total_bytes_read += 1;
+
+    return 1;
+}
 
 uint8_t read_4_byte_unsigned(java_class* jc, uint32_t* resultant_value)
 {
-    uint32_t u4 = 0;
-
-    if (fread(&u4, sizeof(uint32_t), 1, jc->file) != 1)
+    if (jc->image_length - jc->reader->total_bytes_read < 4)
         return 0;
 
-    jc->total_bytes_read += 4;
+    const uint8_t* bytes = jc->image + jc->reader->total_bytes_read;
 
-    if (!LITTLE_ENDIAN_CONVENTION)
-        u4 = (u4 >> 24) | ((u4 & 0xFF0000) >> 8) | ((u4 & 0xFF00) << 8) | ((u4 & 0xFF) << 24);
+    jc->reader->total_bytes_read += 4;
 
     if (resultant_value)
-        *resultant_value = u4;
+        *resultant_value = ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
 
     return 1;
 }
 
 uint8_t read_2_byte_unsigned(java_class* jc, uint16_t* resultant_value)
 {
-    uint16_t u2 = 0;
-
-    if (fread(&u2, sizeof(uint16_t), 1, jc->file) != 1)
+    if (jc->image_length - jc->reader->total_bytes_read < 2)
         return 0;
 
-    jc->total_bytes_read += 2;
+    const uint8_t* bytes = jc->image + jc->reader->total_bytes_read;
 
-    if (!LITTLE_ENDIAN_CONVENTION)
-        u2 = (u2 >> 8) | ((u2 & 0xFF) << 8);
+    jc->reader->total_bytes_read += 2;
 
     if (resultant_value)
-        *resultant_value = u2;
+        *resultant_value = (uint16_t)((bytes[0] << 8) | bytes[1]);
+
+    return 1;
+}
+
+uint8_t read_byte_span(java_class* jc, uint32_t length, const uint8_t** span)
+{
+    if (jc->image_length - jc->reader->total_bytes_read < length)
+        return 0;
+
+    if (span)
+        *span = jc->image + jc->reader->total_bytes_read;
+
+    jc->reader->total_bytes_read += length;
 
     return 1;
 }
@@ -79,19 +94,30 @@ int32_t read_field_descriptor(uint8_t* utf8_bytes, int32_t utf8_length, char che
         {
             uint8_t* id_start = utf8_bytes;
             int32_t id_length = 0;
-
-            do {
-                used_bytes = next_char_utf8(utf8_bytes, utf8_length, &utf8_char);
-
-                if (used_bytes == 0)
-                    return 0;
-
-                utf8_bytes += used_bytes;
-                utf8_length -= used_bytes;
-                total_bytes_read += used_bytes;
-                id_length += used_bytes;
-
-            } while (utf8_char != ';');
+            uint8_t* semicolon = memchr(utf8_bytes, ';', utf8_ascii_prefix_length(utf8_bytes, utf8_length));
+
+            if (semicolon)
+            {
+                id_length = semicolon - utf8_bytes + 1;
+                utf8_bytes += id_length;
+                utf8_length -= id_length;
+                total_bytes_read += id_length;
+            }
+            else
+            {
+                do {
+                    used_bytes = next_char_utf8(utf8_bytes, utf8_length, &utf8_char);
+
+                    if (used_bytes == 0)
+                        return 0;
+
+                    utf8_bytes += used_bytes;
+                    utf8_length -= used_bytes;
+                    total_bytes_read += used_bytes;
+                    id_length += used_bytes;
+
+                } while (utf8_char != ';');
+            }
 
             if (check_valid_identifier_for_class && !java_identifier_is_valid(id_start, id_length - 1, 1))
                 return 0;
@@ -168,6 +194,58 @@ int32_t read_method_descriptor(uint8_t* utf8_bytes, int32_t utf8_length, char ch
     return utf8_length == 0 ? processed_bytes : 0;
 }
 
+uint8_t read_method_signature(java_class* jc, const uint8_t* descriptor, int32_t length, method_signature* signature)
+{
+    uint8_t kinds[255];
+    uint32_t slots = 0;
+    int32_t index = 1;
+    uint8_t count = 0;
+
+    signature->argument_count = 0;
+    signature->argument_slots = 0;
+    signature->return_kind = 'V';
+    signature->argument_kinds = NULL;
+
+    while (index < length && descriptor[index] != ')' && count < sizeof(kinds))
+    {
+        kinds[count] = descriptor[index];
+
+        while (index < length && descriptor[index] == '[')
+            index++;
+
+        if (index < length && descriptor[index] == 'L')
+        {
+            while (index < length && descriptor[index] != ';')
+                index++;
+        }
+
+        slots += kinds[count] == 'J' || kinds[count] == 'D' ? 2 : 1;
+        count++;
+        index++;
+    }
+
+    if (index + 1 < length)
+        signature->return_kind = descriptor[index + 1];
+
+    if (count > 0)
+    {
+        signature->argument_kinds = (uint8_t*)allocate_from_arena(&jc->memory, count);
+
+        if (!signature->argument_kinds)
+        {
+            jc->status = MEM_ALLOC_FAILED;
+            return 0;
+        }
+
+        memcpy(signature->argument_kinds, kinds, count);
+    }
+
+    signature->argument_count = count;
+    signature->argument_slots = slots > 255 ? 255 : (uint8_t)slots;
+
+    return 1;
+}
+
 float get_float_from_uint32(uint32_t value)
 {
     if (value == 0x7F800000UL)
@@ -0,0 +1,845 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "sharedarchive.h"
+#include "mappedfile.h"
+#include "symboltable.h"
+#include "utf8.h"
+
+#define SHARED_ARCHIVE_MAGIC 0x5344434AUL
+#define SHARED_ARCHIVE_VERSION 3
+#define SHARED_ARCHIVE_HEADER_SIZE 24
+#define SHARED_ARCHIVE_ENTRY_SIZE 56
+#define SHARED_ARCHIVE_ALIGN(x) (((x) + 7) & ~7UL)
+#define POINTER_AT(offset, type, member) ((offset) + (uint32_t)offsetof(type, member))
+
+// Layout, all values little-endian and all positions relative to the start
+// of the file so the archive can be mapped anywhere:
+//   header:  magic, version, class count, hash table size, structure layout,
+//            CRC-32 of everything after the header
+//   table:   one u4 per slot, holding entry index + 1 or 0 when empty
+//   entries: name hash, name offset, name length, class offset, class length,
+//            relocation offset, relocation count, source offset, source
+//            length, unused u4, source size (u8), source modification time (u8)
+//   data:    class names and source paths followed by 8-byte aligned classes,
+//            each followed by its relocation table
+// A class is stored as its parsed java_class and everything that points to:
+// constant pool with method signatures and symbol hashes, member indexes,
+// attributes, undecoded Code and the field layout it was linked with.
+// Pointers hold offsets from the start of the class and the relocation table
+// lists where they are. The CRC is checked once when the archive is opened;
+// after that an entry is only used while the file it was loaded from still
+// has the recorded size and modification time.
+
+// First object of every archived class.
+typedef struct archived_class
+{
+    java_class jc;
+    uint32_t* utf8_hashes;
+} archived_class;
+
+typedef struct archive_buffer
+{
+    uint8_t* bytes;
+    uint32_t length;
+    uint32_t capacity;
+    uint32_t* relocations;
+    uint32_t relocation_count;
+    uint32_t relocation_capacity;
+    uint8_t failed;
+} archive_buffer;
+
+static uint32_t read_u4_le(const uint8_t* bytes)
+{
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+// Slicing-by-8: crc_table[k] advances the CRC over a byte followed by k
+// zero bytes, so eight bytes are folded in per step. The whole archive is
+// checked every time it is opened.
+static uint32_t crc_table[8][256];
+static pthread_once_t crc_table_once = PTHREAD_ONCE_INIT;
+
+static void build_crc_table(void)
+{
+    uint32_t index, bit, value, slice;
+
+    for (index = 0; index < 256; index++)
+    {
+        for (value = index, bit = 0; bit < 8; bit++)
+            value = (value >> 1) ^ (value & 1 ? 0xEDB88320UL : 0);
+
+        crc_table[0][index] = value;
+    }
+
+    for (slice = 1; slice < 8; slice++)
+    {
+        for (index = 0; index < 256; index++)
+            crc_table[slice][index] = (crc_table[slice - 1][index] >> 8) ^ crc_table[0][crc_table[slice - 1][index] & 0xFF];
+    }
+}
+
+static uint32_t compute_crc32(const uint8_t* bytes, uint32_t length)
+{
+    uint32_t crc = 0xFFFFFFFFUL;
+    uint32_t high;
+
+    pthread_once(&crc_table_once, build_crc_table);
+
+    for (; length >= 8; bytes += 8, length -= 8)
+    {
+        crc ^= read_u4_le(bytes);
+        high = read_u4_le(bytes + 4);
+        crc = crc_table[7][crc & 0xFF] ^ crc_table[6][(crc >> 8) & 0xFF] ^
+              crc_table[5][(crc >> 16) & 0xFF] ^ crc_table[4][crc >> 24] ^
+              crc_table[3][high & 0xFF] ^ crc_table[2][(high >> 8) & 0xFF] ^
+              crc_table[1][(high >> 16) & 0xFF] ^ crc_table[0][high >> 24];
+    }
+
+    while (length--)
+        crc = crc_table[0][(crc ^ *bytes++) & 0xFF] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+static void write_u4_le(uint8_t* bytes, uint32_t value)
+{
+    bytes[0] = (uint8_t)value;
+    bytes[1] = (uint8_t)(value >> 8);
+    bytes[2] = (uint8_t)(value >> 16);
+    bytes[3] = (uint8_t)(value >> 24);
+}
+
+static uint64_t read_u8_le(const uint8_t* bytes)
+{
+    return (uint64_t)read_u4_le(bytes) | ((uint64_t)read_u4_le(bytes + 4) << 32);
+}
+
+static void write_u8_le(uint8_t* bytes, uint64_t value)
+{
+    write_u4_le(bytes, (uint32_t)value);
+    write_u4_le(bytes + 4, (uint32_t)(value >> 32));
+}
+
+static uint8_t get_source_stamp(const char* path, uint64_t* size, uint64_t* modified)
+{
+    struct stat file_info;
+
+    if (stat(path, &file_info) != 0)
+        return 0;
+
+    *size = (uint64_t)file_info.st_size;
+    *modified = (uint64_t)file_info.st_mtime;
+
+    return 1;
+}
+
+static uint8_t source_is_unchanged(shared_archive* archive, const uint8_t* entry)
+{
+    uint32_t source_offset = read_u4_le(entry + 28);
+    uint32_t source_length = read_u4_le(entry + 32);
+    uint64_t size, modified;
+    char path[1024];
+
+    if (source_offset > archive->image_length || archive->image_length - source_offset < source_length ||
+        source_length == 0 || source_length >= sizeof(path))
+    {
+        return 0;
+    }
+
+    memcpy(path, archive->image + source_offset, source_length);
+    path[source_length] = '\0';
+
+    return get_source_stamp(path, &size, &modified) &&
+           size == read_u8_le(entry + 40) && modified == read_u8_le(entry + 48);
+}
+
+static constant_pool_info* get_class_name(java_class* jc)
+{
+    constant_pool_info* cpi = jc->constant_pool + jc->this_class - 1;
+    return jc->constant_pool + cpi->Class.name_index - 1;
+}
+
+// Archived classes are the VM's own structures, so an archive is only used
+// by a build that lays them out, and hashes symbols, the same way.
+static uint32_t get_structure_layout(void)
+{
+    uint32_t layout = utf8_hash((const uint8_t*)"java/lang/Object", 16);
+
+    layout = layout * 31 + sizeof(void*);
+    layout = layout * 31 + sizeof(archived_class);
+    layout = layout * 31 + sizeof(constant_pool_info);
+    layout = layout * 31 + sizeof(method_signature);
+    layout = layout * 31 + sizeof(field_info);
+    layout = layout * 31 + sizeof(method_info);
+    layout = layout * 31 + sizeof(member_index_entry);
+    layout = layout * 31 + sizeof(attribute_info);
+    layout = layout * 31 + sizeof(attr_code_info);
+
+    return layout;
+}
+
+shared_archive* open_shared_archive(const char* path)
+{
+    shared_archive* archive = (shared_archive*)malloc(sizeof(shared_archive));
+    uint32_t table_size;
+
+    if (!archive)
+        return NULL;
+
+    if (!map_file(path, &archive->image, &archive->image_length, &archive->image_mapped))
+    {
+        free(archive);
+        return NULL;
+    }
+
+    if (archive->image_length < SHARED_ARCHIVE_HEADER_SIZE ||
+        read_u4_le(archive->image) != SHARED_ARCHIVE_MAGIC ||
+        read_u4_le(archive->image + 4) != SHARED_ARCHIVE_VERSION ||
+        read_u4_le(archive->image + 16) != get_structure_layout() ||
+        read_u4_le(archive->image + 20) != compute_crc32(archive->image + SHARED_ARCHIVE_HEADER_SIZE, archive->image_length - SHARED_ARCHIVE_HEADER_SIZE))
+    {
+        close_shared_archive(archive);
+        return NULL;
+    }
+
+    archive->class_count = read_u4_le(archive->image + 8);
+    table_size = read_u4_le(archive->image + 12);
+
+    if (table_size == 0 || (table_size & (table_size - 1)) ||
+        (archive->image_length - SHARED_ARCHIVE_HEADER_SIZE) / 4 < table_size ||
+        (archive->image_length - SHARED_ARCHIVE_HEADER_SIZE - table_size * 4) / SHARED_ARCHIVE_ENTRY_SIZE < archive->class_count)
+    {
+        close_shared_archive(archive);
+        return NULL;
+    }
+
+    archive->table_mask = table_size - 1;
+    archive->table = archive->image + SHARED_ARCHIVE_HEADER_SIZE;
+    archive->entries = archive->table + table_size * 4;
+
+    return archive;
+}
+
+void close_shared_archive(shared_archive* archive)
+{
+    if (!archive)
+        return;
+
+    unmap_file(archive->image, archive->image_length, archive->image_mapped);
+    free(archive);
+}
+
+static uint8_t span_is_inside(shared_archive* archive, uint32_t offset, uint32_t length)
+{
+    return offset <= archive->image_length && archive->image_length - offset >= length;
+}
+
+static const uint8_t* find_shared_entry(shared_archive* archive, const uint8_t* name, int32_t name_length)
+{
+    uint32_t hash = utf8_hash(name, name_length);
+    uint32_t slot = hash & archive->table_mask;
+    uint32_t probes, index;
+    const uint8_t* entry;
+
+    for (probes = 0; probes <= archive->table_mask; probes++)
+    {
+        index = read_u4_le(archive->table + slot * 4);
+
+        if (index == 0 || index > archive->class_count)
+            return NULL;
+
+        entry = archive->entries + (index - 1) * SHARED_ARCHIVE_ENTRY_SIZE;
+
+        if (read_u4_le(entry) == hash && span_is_inside(archive, read_u4_le(entry + 4), read_u4_le(entry + 8)) &&
+            compare_utf8(archive->image + read_u4_le(entry + 4), read_u4_le(entry + 8), name, name_length))
+        {
+            return entry;
+        }
+
+        slot = (slot + 1) & archive->table_mask;
+    }
+
+    return NULL;
+}
+
+// Copies the archived class into the class's arena and points it at its own
+// memory. Symbols are interned with their archived hashes.
+uint8_t restore_shared_class(shared_archive* archive, const uint8_t* name, int32_t name_length, java_class* jc)
+{
+    const uint8_t* entry = find_shared_entry(archive, name, name_length);
+    uint32_t data_offset, data_length, relocation_offset, relocation_count;
+    uint32_t index, position;
+    archived_class* archived;
+    constant_pool_info* cpi;
+    uint8_t* data;
+    uintptr_t target;
+    void* pointer;
+    symbol* sym;
+    arena memory;
+    uint16_t u16;
+
+    if (!entry || !source_is_unchanged(archive, entry))
+        return 0;
+
+    data_offset = read_u4_le(entry + 12);
+    data_length = read_u4_le(entry + 16);
+    relocation_offset = read_u4_le(entry + 20);
+    relocation_count = read_u4_le(entry + 24);
+
+    if (data_length < sizeof(archived_class) || !span_is_inside(archive, data_offset, data_length) ||
+        relocation_count > UINT32_MAX / 4 || !span_is_inside(archive, relocation_offset, relocation_count * 4))
+    {
+        return 0;
+    }
+
+    data = (uint8_t*)allocate_from_arena(&jc->memory, data_length);
+
+    if (!data)
+        return 0;
+
+    memcpy(data, archive->image + data_offset, data_length);
+
+    for (index = 0; index < relocation_count; index++)
+    {
+        position = read_u4_le(archive->image + relocation_offset + index * 4);
+
+        if (position > data_length - sizeof(pointer))
+            return 0;
+
+        memcpy(&pointer, data + position, sizeof(pointer));
+        target = (uintptr_t)pointer;
+
+        if (target == 0 || target >= data_length)
+            return 0;
+
+        pointer = data + target;
+        memcpy(data + position, &pointer, sizeof(pointer));
+    }
+
+    archived = (archived_class*)data;
+    memory = jc->memory;
+    *jc = archived->jc;
+    jc->memory = memory;
+
+    for (u16 = 0; u16 + 1 < jc->constant_pool_count; u16++)
+    {
+        cpi = jc->constant_pool + u16;
+
+        if (cpi->tag == UTF8_CONST)
+        {
+            sym = intern_symbol_with_hash(cpi->Utf8.bytes, cpi->Utf8.length, archived->utf8_hashes[u16]);
+
+            if (!sym)
+                return 0;
+
+            cpi->Utf8.bytes = sym->bytes;
+            cpi->Utf8.sym = sym;
+        }
+        else if (cpi->tag == DOUBLE_CONST || cpi->tag == LONG_CONST)
+        {
+            u16++;
+        }
+    }
+
+    return 1;
+}
+
+// Appends length bytes, copied from data or zeroed when data is NULL, and
+// returns their offset in the buffer.
+static uint32_t append_to_buffer(archive_buffer* buffer, const void* data, uint32_t length)
+{
+    uint32_t offset = SHARED_ARCHIVE_ALIGN(buffer->length);
+    uint32_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    uint8_t* bytes;
+
+    if (buffer->failed)
+        return 0;
+
+    while (capacity < offset + length)
+        capacity *= 2;
+
+    if (capacity != buffer->capacity)
+    {
+        bytes = (uint8_t*)realloc(buffer->bytes, capacity);
+
+        if (!bytes)
+        {
+            buffer->failed = 1;
+            return 0;
+        }
+
+        memset(bytes + buffer->capacity, 0, capacity - buffer->capacity);
+        buffer->bytes = bytes;
+        buffer->capacity = capacity;
+    }
+
+    if (data && length > 0)
+        memcpy(buffer->bytes + offset, data, length);
+
+    buffer->length = offset + length;
+    return offset;
+}
+
+// Stores a pointer to the object at target in the pointer at position. The
+// class itself is at offset 0, which no pointer refers to, so a target of 0
+// stores NULL and needs no relocation.
+static void set_buffer_pointer(archive_buffer* buffer, uint32_t position, uint32_t target)
+{
+    void* pointer = (void*)(uintptr_t)target;
+    uint32_t* relocations;
+
+    if (buffer->failed)
+        return;
+
+    memcpy(buffer->bytes + position, &pointer, sizeof(pointer));
+
+    if (target == 0)
+        return;
+
+    if (buffer->relocation_count == buffer->relocation_capacity)
+    {
+        buffer->relocation_capacity = buffer->relocation_capacity ? buffer->relocation_capacity * 2 : 256;
+        relocations = (uint32_t*)realloc(buffer->relocations, buffer->relocation_capacity * sizeof(uint32_t));
+
+        if (!relocations)
+        {
+            buffer->failed = 1;
+            return;
+        }
+
+        buffer->relocations = relocations;
+    }
+
+    buffer->relocations[buffer->relocation_count++] = position;
+}
+
+static uint32_t get_buffer_pointer(archive_buffer* buffer, uint32_t position)
+{
+    void* pointer = NULL;
+
+    if (!buffer->failed)
+        memcpy(&pointer, buffer->bytes + position, sizeof(pointer));
+
+    return (uint32_t)(uintptr_t)pointer;
+}
+
+// Copies length bytes from data into the buffer and points the pointer at
+// position to them. Returns their offset, or 0 when there was nothing to copy.
+static uint32_t archive_block(archive_buffer* buffer, uint32_t position, const void* data, uint32_t length)
+{
+    uint32_t offset = 0;
+
+    if (data && length > 0)
+        offset = append_to_buffer(buffer, data, length);
+
+    set_buffer_pointer(buffer, position, offset);
+    return offset;
+}
+
+static void archive_attributes(archive_buffer*, uint32_t, attribute_info*, uint16_t);
+
+static void archive_code(archive_buffer* buffer, uint32_t position, attr_code_info* code)
+{
+    uint32_t offset = archive_block(buffer, position, code, sizeof(attr_code_info));
+
+    if (!offset)
+        return;
+
+    archive_block(buffer, POINTER_AT(offset, attr_code_info, code), code->code, code->code_length);
+    archive_block(buffer, POINTER_AT(offset, attr_code_info, exception_table), code->exception_table,
+                  code->exception_table_length * sizeof(exception_table_entry));
+    archive_attributes(buffer, POINTER_AT(offset, attr_code_info, attributes), code->attributes, code->attributes_count);
+}
+
+static void archive_attributes(archive_buffer* buffer, uint32_t position, attribute_info* attributes, uint16_t count)
+{
+    uint32_t offset = archive_block(buffer, position, attributes, count * sizeof(attribute_info));
+    uint32_t info;
+    uint16_t u16;
+
+    for (u16 = 0; offset && u16 < count; u16++)
+    {
+        position = POINTER_AT(offset + u16 * sizeof(attribute_info), attribute_info, info);
+
+        switch (attributes[u16].attr_type)
+        {
+            case ATTRIBUTE_ConstantValue:
+                archive_block(buffer, position, attributes[u16].info, sizeof(atrt_const_value_info));
+                break;
+
+            case ATTRIBUTE_SourceFile:
+                archive_block(buffer, position, attributes[u16].info, sizeof(attr_sourcefile_info));
+                break;
+
+            case ATTRIBUTE_InnerClasses:
+            {
+                attr_inner_classes_info* inner = (attr_inner_classes_info*)attributes[u16].info;
+
+                if ((info = archive_block(buffer, position, inner, sizeof(attr_inner_classes_info))))
+                    archive_block(buffer, POINTER_AT(info, attr_inner_classes_info, inner_classes), inner->inner_classes,
+                                  inner->number_of_classes * sizeof(inner_class_info));
+                break;
+            }
+
+            case ATTRIBUTE_LineNumberTable:
+            {
+                attr_line_number_table_info* lines = (attr_line_number_table_info*)attributes[u16].info;
+
+                if ((info = archive_block(buffer, position, lines, sizeof(attr_line_number_table_info))))
+                    archive_block(buffer, POINTER_AT(info, attr_line_number_table_info, line_number_table), lines->line_number_table,
+                                  lines->line_number_table_length * sizeof(line_number_table_entry));
+                break;
+            }
+
+            case ATTRIBUTE_Exceptions:
+            {
+                attr_exceptions_info* exceptions = (attr_exceptions_info*)attributes[u16].info;
+
+                if ((info = archive_block(buffer, position, exceptions, sizeof(attr_exceptions_info))))
+                    archive_block(buffer, POINTER_AT(info, attr_exceptions_info, exception_index_table), exceptions->exception_index_table,
+                                  exceptions->number_of_exceptions * sizeof(uint16_t));
+                break;
+            }
+
+            case ATTRIBUTE_Code:
+                archive_code(buffer, position, (attr_code_info*)attributes[u16].info);
+                break;
+
+            default:
+                set_buffer_pointer(buffer, position, 0);
+                break;
+        }
+    }
+}
+
+static void archive_constant_pool(archive_buffer* buffer, java_class* jc)
+{
+    uint32_t offset, entry;
+    uint32_t* hashes;
+    constant_pool_info* cpi;
+    uint16_t u16;
+
+    if (jc->constant_pool_count < 2)
+        return;
+
+    hashes = (uint32_t*)calloc(jc->constant_pool_count - 1, sizeof(uint32_t));
+
+    if (!hashes)
+    {
+        buffer->failed = 1;
+        return;
+    }
+
+    offset = archive_block(buffer, POINTER_AT(0, java_class, constant_pool), jc->constant_pool,
+                           (jc->constant_pool_count - 1) * sizeof(constant_pool_info));
+
+    for (u16 = 0; offset && u16 + 1 < jc->constant_pool_count; u16++)
+    {
+        cpi = jc->constant_pool + u16;
+        entry = offset + u16 * sizeof(constant_pool_info);
+
+        switch (cpi->tag)
+        {
+            case UTF8_CONST:
+                hashes[u16] = cpi->Utf8.sym->hash;
+                archive_block(buffer, POINTER_AT(entry, constant_pool_info, Utf8.bytes), cpi->Utf8.bytes, cpi->Utf8.length);
+                set_buffer_pointer(buffer, POINTER_AT(entry, constant_pool_info, Utf8.sym), 0);
+                break;
+
+            case CLASS_CONST:
+                set_buffer_pointer(buffer, POINTER_AT(entry, constant_pool_info, Class.resolved_class), 0);
+                break;
+
+            case STRING_CONST:
+                set_buffer_pointer(buffer, POINTER_AT(entry, constant_pool_info, String.resolved_string), 0);
+                break;
+
+            case FIELDREF_CONST:
+                set_buffer_pointer(buffer, POINTER_AT(entry, constant_pool_info, Fieldref.resolved_class), 0);
+                set_buffer_pointer(buffer, POINTER_AT(entry, constant_pool_info, Fieldref.resolved_field), 0);
+                break;
+
+            case METHODREF_CONST:
+            case INTERFACEMETHODREF_CONST:
+                set_buffer_pointer(buffer, POINTER_AT(entry, constant_pool_info, Methodref.resolved_class), 0);
+                set_buffer_pointer(buffer, POINTER_AT(entry, constant_pool_info, Methodref.resolved_method), 0);
+                set_buffer_pointer(buffer, POINTER_AT(entry, constant_pool_info, Methodref.resolved_target), 0);
+                break;
+
+            case NAMEANDTYPE_CONST:
+                if (cpi->NameAndType.signature &&
+                    (entry = archive_block(buffer, POINTER_AT(entry, constant_pool_info, NameAndType.signature), cpi->NameAndType.signature, sizeof(method_signature))))
+                {
+                    archive_block(buffer, POINTER_AT(entry, method_signature, argument_kinds), cpi->NameAndType.signature->argument_kinds,
+                                  cpi->NameAndType.signature->argument_count);
+                }
+                break;
+
+            case LONG_CONST:
+            case DOUBLE_CONST:
+                u16++;
+                break;
+        }
+    }
+
+    archive_block(buffer, POINTER_AT(0, archived_class, utf8_hashes), hashes, (jc->constant_pool_count - 1) * sizeof(uint32_t));
+    free(hashes);
+}
+
+static void archive_members(archive_buffer* buffer, java_class* jc)
+{
+    uint32_t offset, member, code;
+    method_info* method;
+    uint16_t u16, index;
+
+    offset = archive_block(buffer, POINTER_AT(0, java_class, fields), jc->fields, jc->field_count * sizeof(field_info));
+
+    for (u16 = 0; offset && u16 < jc->field_count; u16++)
+        archive_attributes(buffer, POINTER_AT(offset + u16 * sizeof(field_info), field_info, attributes),
+                           jc->fields[u16].attributes, jc->fields[u16].attributes_count);
+
+    offset = archive_block(buffer, POINTER_AT(0, java_class, methods), jc->methods, jc->method_count * sizeof(method_info));
+
+    for (u16 = 0; offset && u16 < jc->method_count; u16++)
+    {
+        method = jc->methods + u16;
+        member = offset + u16 * sizeof(method_info);
+        code = 0;
+
+        archive_attributes(buffer, POINTER_AT(member, method_info, attributes), method->attributes, method->attributes_count);
+        archive_block(buffer, POINTER_AT(member, method_info, signature.argument_kinds), method->signature.argument_kinds,
+                      method->signature.argument_count);
+
+        // code is the info of one of the method's Code attributes.
+        for (index = 0; method->code && index < method->attributes_count; index++)
+        {
+            if (method->attributes[index].info == method->code)
+            {
+                code = get_buffer_pointer(buffer, POINTER_AT(get_buffer_pointer(buffer, POINTER_AT(member, method_info, attributes)) +
+                                                             index * sizeof(attribute_info), attribute_info, info));
+                break;
+            }
+        }
+
+        set_buffer_pointer(buffer, POINTER_AT(member, method_info, code), code);
+    }
+
+    archive_block(buffer, POINTER_AT(0, java_class, field_index), jc->field_index,
+                  jc->field_index ? (jc->field_index_mask + 1) * sizeof(member_index_entry) : 0);
+    archive_block(buffer, POINTER_AT(0, java_class, method_index), jc->method_index,
+                  jc->method_index ? (jc->method_index_mask + 1) * sizeof(member_index_entry) : 0);
+}
+
+// Parses the class again from its image, so the archive holds the class as
+// loading left it rather than as running it changed it, and gives it the
+// field layout it was linked with.
+static uint8_t archive_class(archive_buffer* buffer, java_class* linked)
+{
+    archived_class header;
+    java_class jc;
+    uint32_t code_length = 0;
+    uint16_t u16;
+
+    open_verified_class_from_memory(&jc, linked->image, linked->image_length);
+
+    if (jc.status != CLASS_STA_OK || jc.field_count != linked->field_count || !detach_code_attributes(&jc))
+    {
+        close_class_file(&jc);
+        return 0;
+    }
+
+    for (u16 = 0; u16 < jc.field_count; u16++)
+        jc.fields[u16].offset = linked->fields[u16].offset;
+
+    for (u16 = 0; u16 < jc.method_count; u16++)
+    {
+        if (jc.methods[u16].code)
+            code_length += jc.methods[u16].code->encoded_length;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.jc = jc;
+    header.jc.image = NULL;
+    header.jc.image_length = 0;
+    header.jc.image_source = CLASS_IMAGE_NONE;
+    header.jc.source_path = NULL;
+    header.jc.instance_size = linked->instance_size;
+    header.jc.reference_slot_count = linked->reference_slot_count;
+    header.jc.layout_archived = 1;
+    header.jc.reader = NULL;
+    memset(&header.jc.memory, 0, sizeof(arena));
+
+    append_to_buffer(buffer, &header, sizeof(header));
+    archive_constant_pool(buffer, &jc);
+    archive_block(buffer, POINTER_AT(0, java_class, interfaces), jc.interfaces, jc.interface_count * sizeof(uint16_t));
+    archive_members(buffer, &jc);
+    archive_attributes(buffer, POINTER_AT(0, java_class, attributes), jc.attributes, jc.attribute_count);
+    archive_block(buffer, POINTER_AT(0, java_class, reference_slots), linked->reference_slots,
+                  linked->reference_slot_count * sizeof(uint16_t));
+    archive_block(buffer, POINTER_AT(0, java_class, code_image), jc.code_image, code_length);
+
+    close_class_file(&jc);
+
+    return !buffer->failed;
+}
+
+// Lays out the archived classes with their names and sources. Returns the
+// archive, or NULL when memory runs out or a source can no longer be read.
+static uint8_t* assemble_shared_archive(java_class** classes, archive_buffer* buffers, uint32_t class_count, uint32_t* size)
+{
+    uint32_t table_size = 1;
+    uint32_t index, slot, hash, source_length, relocation;
+    uint32_t name_offset, data_offset;
+    uint64_t source_size, source_modified;
+    constant_pool_info* name;
+    uint8_t* archive;
+    uint8_t* entry;
+
+    while (table_size < class_count * 2)
+        table_size <<= 1;
+
+    name_offset = SHARED_ARCHIVE_HEADER_SIZE + table_size * 4 + class_count * SHARED_ARCHIVE_ENTRY_SIZE;
+    *size = name_offset;
+
+    for (index = 0; index < class_count; index++)
+        *size += get_class_name(classes[index])->Utf8.length + strlen(classes[index]->source_path);
+
+    for (index = 0; index < class_count; index++)
+        *size = SHARED_ARCHIVE_ALIGN(*size) + buffers[index].length + buffers[index].relocation_count * 4;
+
+    archive = (uint8_t*)calloc(*size, 1);
+
+    if (!archive)
+        return NULL;
+
+    write_u4_le(archive, SHARED_ARCHIVE_MAGIC);
+    write_u4_le(archive + 4, SHARED_ARCHIVE_VERSION);
+    write_u4_le(archive + 8, class_count);
+    write_u4_le(archive + 12, table_size);
+    write_u4_le(archive + 16, get_structure_layout());
+
+    data_offset = name_offset;
+
+    for (index = 0; index < class_count; index++)
+        data_offset += get_class_name(classes[index])->Utf8.length + strlen(classes[index]->source_path);
+
+    for (index = 0; index < class_count; index++)
+    {
+        name = get_class_name(classes[index]);
+        hash = utf8_hash(UTF8(name));
+        entry = archive + SHARED_ARCHIVE_HEADER_SIZE + table_size * 4 + index * SHARED_ARCHIVE_ENTRY_SIZE;
+        data_offset = SHARED_ARCHIVE_ALIGN(data_offset);
+        source_length = strlen(classes[index]->source_path);
+
+        if (!get_source_stamp(classes[index]->source_path, &source_size, &source_modified))
+        {
+            free(archive);
+            return NULL;
+        }
+
+        write_u4_le(entry, hash);
+        write_u4_le(entry + 4, name_offset);
+        write_u4_le(entry + 8, name->Utf8.length);
+        write_u4_le(entry + 12, data_offset);
+        write_u4_le(entry + 16, buffers[index].length);
+        write_u4_le(entry + 20, data_offset + buffers[index].length);
+        write_u4_le(entry + 24, buffers[index].relocation_count);
+        write_u4_le(entry + 28, name_offset + name->Utf8.length);
+        write_u4_le(entry + 32, source_length);
+        write_u8_le(entry + 40, source_size);
+        write_u8_le(entry + 48, source_modified);
+
+        memcpy(archive + name_offset, name->Utf8.bytes, name->Utf8.length);
+        memcpy(archive + name_offset + name->Utf8.length, classes[index]->source_path, source_length);
+        memcpy(archive + data_offset, buffers[index].bytes, buffers[index].length);
+
+        name_offset += name->Utf8.length + source_length;
+        data_offset += buffers[index].length;
+
+        for (relocation = 0; relocation < buffers[index].relocation_count; relocation++, data_offset += 4)
+            write_u4_le(archive + data_offset, buffers[index].relocations[relocation]);
+
+        for (slot = hash & (table_size - 1); read_u4_le(archive + SHARED_ARCHIVE_HEADER_SIZE + slot * 4); slot = (slot + 1) & (table_size - 1));
+
+        write_u4_le(archive + SHARED_ARCHIVE_HEADER_SIZE + slot * 4, index + 1);
+    }
+
+    write_u4_le(archive + 20, compute_crc32(archive + SHARED_ARCHIVE_HEADER_SIZE, *size - SHARED_ARCHIVE_HEADER_SIZE));
+
+    return archive;
+}
+
+uint8_t write_shared_archive(const char* path, java_class** classes, uint32_t class_count)
+{
+    char temporary_path[1024];
+    archive_buffer* buffers;
+    uint32_t index, archived_count, size;
+    uint8_t* archive;
+    FILE* file;
+    uint8_t success;
+
+    buffers = (archive_buffer*)calloc(class_count ? class_count : 1, sizeof(archive_buffer));
+
+    if (!buffers)
+        return 0;
+
+    // Classes that fail to archive are left out and load from their files.
+    for (index = archived_count = 0; index < class_count; index++)
+    {
+        if (archive_class(buffers + archived_count, classes[index]))
+        {
+            classes[archived_count++] = classes[index];
+            continue;
+        }
+
+        free(buffers[archived_count].bytes);
+        free(buffers[archived_count].relocations);
+        memset(buffers + archived_count, 0, sizeof(archive_buffer));
+    }
+
+    archive = assemble_shared_archive(classes, buffers, archived_count, &size);
+
+    for (index = 0; index < archived_count; index++)
+    {
+        free(buffers[index].bytes);
+        free(buffers[index].relocations);
+    }
+
+    free(buffers);
+
+    if (!archive)
+        return 0;
+
+    // Write next to the destination and rename, so a VM starting concurrently
+    // never maps a half-written archive.
+    snprintf(temporary_path, sizeof(temporary_path), "%s.tmp", path);
+    file = fopen(temporary_path, "wb");
+
+    if (!file)
+    {
+        free(archive);
+        return 0;
+    }
+
+    success = fwrite(archive, 1, size, file) == size;
+    success = fclose(file) == 0 && success;
+    free(archive);
+
+    if (success)
+    {
+#ifdef _WIN32
+        remove(path);
+#endif
+        success = rename(temporary_path, path) == 0;
+    }
+
+    if (!success)
+        remove(temporary_path);
+
+    return success;
+}
@@ -0,0 +1,24 @@
+#ifndef SHAREDARCHIVE_H
+#define SHAREDARCHIVE_H
+
+#include <stdint.h>
+#include "javaclass.h"
+
+typedef struct shared_archive
+{
+    const uint8_t* image;
+    uint32_t image_length;
+    uint8_t image_mapped;
+    uint32_t class_count;
+    uint32_t table_mask;
+    const uint8_t* table;
+    const uint8_t* entries;
+} shared_archive;
+
+shared_archive* open_shared_archive(const char*);
+void close_shared_archive(shared_archive*);
+uint8_t restore_shared_class(shared_archive*, const uint8_t*, int32_t,
+        java_class*);
+uint8_t write_shared_archive(const char*, java_class**, uint32_t);
+
+#endif
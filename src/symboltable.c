@@ -0,0 +1,139 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "symboltable.h"
+#include "utf8.h"
+#include "arena.h"
+
+#define SYMBOL_TABLE_INITIAL_SIZE 1024
+#define SYMBOL_BLOCK_SIZE 65536
+
+static symbol** symbol_table = NULL;
+static uint32_t symbol_table_size = 0;
+static uint32_t symbol_count = 0;
+static arena symbol_memory = { NULL, SYMBOL_BLOCK_SIZE };
+static pthread_mutex_t symbol_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint8_t grow_symbol_table(void)
+{
+    uint32_t new_size = symbol_table_size ? symbol_table_size * 2 : SYMBOL_TABLE_INITIAL_SIZE;
+    symbol** new_table = (symbol**)calloc(new_size, sizeof(symbol*));
+
+    if (!new_table)
+        return 0;
+
+    uint32_t index;
+    symbol* sym;
+    symbol* next;
+
+    for (index = 0; index < symbol_table_size; index++)
+    {
+        for (sym = symbol_table[index]; sym; sym = next)
+        {
+            next = sym->next;
+            sym->next = new_table[sym->hash & (new_size - 1)];
+            new_table[sym->hash & (new_size - 1)] = sym;
+        }
+    }
+
+    if (symbol_table)
+        free(symbol_table);
+
+    symbol_table = new_table;
+    symbol_table_size = new_size;
+
+    return 1;
+}
+
+static symbol* find_symbol(const uint8_t* utf8_bytes, int32_t utf8_len, uint32_t hash)
+{
+    symbol* sym;
+
+    if (!symbol_table)
+        return NULL;
+
+    for (sym = symbol_table[hash & (symbol_table_size - 1)]; sym; sym = sym->next)
+    {
+        if (sym->hash == hash && compare_utf8(SYMBOL(sym), utf8_bytes, utf8_len))
+            return sym;
+    }
+
+    return NULL;
+}
+
+static symbol* add_symbol(const uint8_t* utf8_bytes, int32_t utf8_len, uint32_t hash)
+{
+    symbol* sym = find_symbol(utf8_bytes, utf8_len, hash);
+
+    if (sym)
+        return sym;
+
+    if ((symbol_count + 1) * 4 > symbol_table_size * 3 && !grow_symbol_table())
+        return NULL;
+
+    sym = (symbol*)allocate_from_arena(&symbol_memory, sizeof(symbol) + utf8_len);
+
+    if (!sym)
+        return NULL;
+
+    sym->hash = hash;
+    sym->length = (uint16_t)utf8_len;
+    sym->bytes = (uint8_t*)(sym + 1);
+
+    if (utf8_len > 0)
+        memcpy(sym->bytes, utf8_bytes, utf8_len);
+
+    sym->next = symbol_table[hash & (symbol_table_size - 1)];
+    symbol_table[hash & (symbol_table_size - 1)] = sym;
+    symbol_count++;
+
+    return sym;
+}
+
+// For bytes whose utf8_hash is already known, such as archived symbols.
+symbol* intern_symbol_with_hash(const uint8_t* utf8_bytes, int32_t utf8_len, uint32_t hash)
+{
+    symbol* sym;
+
+    // Class files may be parsed by the prefetch workers concurrently.
+    pthread_mutex_lock(&symbol_lock);
+    sym = add_symbol(utf8_bytes, utf8_len, hash);
+    pthread_mutex_unlock(&symbol_lock);
+
+    return sym;
+}
+
+symbol* intern_symbol(const uint8_t* utf8_bytes, int32_t utf8_len)
+{
+    return intern_symbol_with_hash(utf8_bytes, utf8_len, utf8_hash(utf8_bytes, utf8_len));
+}
+
+symbol* intern_symbol_ascii(const char* ascii)
+{
+    return intern_symbol((const uint8_t*)ascii, strlen(ascii));
+}
+
+symbol* lookup_symbol(const uint8_t* utf8_bytes, int32_t utf8_len)
+{
+    uint32_t hash = utf8_hash(utf8_bytes, utf8_len);
+    symbol* sym;
+
+    pthread_mutex_lock(&symbol_lock);
+    sym = find_symbol(utf8_bytes, utf8_len, hash);
+    pthread_mutex_unlock(&symbol_lock);
+
+    return sym;
+}
+
+void free_symbol_table(void)
+{
+    release_arena(&symbol_memory);
+
+    if (symbol_table)
+        free(symbol_table);
+
+    symbol_table = NULL;
+    symbol_table_size = 0;
+    symbol_count = 0;
+}
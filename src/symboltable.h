@@ -0,0 +1,23 @@
+#ifndef SYMBOLTABLE_H
+#define SYMBOLTABLE_H
+
+typedef struct symbol symbol;
+
+#include <stdint.h>
+
+struct symbol {
+    uint32_t hash;
+    uint16_t length;
+    uint8_t* bytes;
+    symbol* next;
+};
+
+#define SYMBOL(x) x->bytes, x->length
+
+symbol* intern_symbol(const uint8_t*, int32_t);
+symbol* intern_symbol_ascii(const char*);
+symbol* intern_symbol_with_hash(const uint8_t*, int32_t, uint32_t);
+symbol* lookup_symbol(const uint8_t*, int32_t);
+void free_symbol_table(void);
+
+#endif
@@ -9,6 +9,9 @@
 #define FOLLOW_BYTE_MASK  0xC0
 #define FOLLOW_BYTE_VALUE 0x80
 
+#define HASH_OFFSET_BASIS 2166136261UL
+#define HASH_PRIME        16777619UL
+
 uint8_t next_char_utf8(const uint8_t* utf8_bytes, int32_t utf8_len, uint32_t* outCharacter)
 {
     if (utf8_len <= 0)
@@ -194,3 +197,16 @@ uint32_t utf8_string_length(const uint8_t* utf8_bytes, int32_t utf8_len)
 
     return length;
 }
+
+uint32_t utf8_hash(const uint8_t* utf8_bytes, int32_t utf8_len)
+{
+    uint32_t hash = HASH_OFFSET_BASIS;
+
+    while (utf8_len-- > 0)
+    {
+        hash ^= *utf8_bytes++;
+        hash *= HASH_PRIME;
+    }
+
+    return hash;
+}
@@ -14,5 +14,8 @@ char compare_filepath_utf8(const uint8_t*, int32_t, const uint8_t*, int32_t);
 uint32_t translate_from_utf8_to_ascii(uint8_t*, int32_t, const uint8_t*,
         int32_t);
 uint32_t utf8_string_length(const uint8_t*, int32_t);
+uint32_t utf8_hash(const uint8_t*, int32_t);
+int32_t utf8_ascii_prefix_length(const uint8_t*, int32_t);
+int32_t utf8_identifier_prefix_length(const uint8_t*, int32_t);
 
 #endif
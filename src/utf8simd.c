@@ -0,0 +1,178 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include "utf8.h"
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define UTF8_SIMD_X86
+#include <immintrin.h>
+#endif
+
+// Bytes that may appear in an identifier without further checks: ASCII
+// letters, digits, '_', '$' and '/'. Where digits and '/' are allowed is
+// left to the caller.
+static uint8_t identifier_byte[128];
+
+static int32_t (*ascii_prefix)(const uint8_t*, int32_t);
+static int32_t (*identifier_prefix)(const uint8_t*, int32_t);
+static pthread_once_t dispatch_once = PTHREAD_ONCE_INIT;
+
+static int32_t ascii_prefix_scalar(const uint8_t* utf8_bytes, int32_t utf8_len)
+{
+    int32_t i;
+
+    for (i = 0; i < utf8_len; i++)
+    {
+        if (utf8_bytes[i] == 0 || utf8_bytes[i] >= 0x80)
+            break;
+    }
+
+    return i;
+}
+
+static int32_t identifier_prefix_scalar(const uint8_t* utf8_bytes, int32_t utf8_len)
+{
+    int32_t i;
+
+    for (i = 0; i < utf8_len; i++)
+    {
+        if (utf8_bytes[i] >= 0x80 || !identifier_byte[utf8_bytes[i]])
+            break;
+    }
+
+    return i;
+}
+
+#ifdef UTF8_SIMD_X86
+
+__attribute__((target("sse2")))
+static int32_t ascii_prefix_sse2(const uint8_t* utf8_bytes, int32_t utf8_len)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i chunk;
+    uint32_t mask;
+    int32_t i;
+
+    for (i = 0; i + 16 <= utf8_len; i += 16)
+    {
+        chunk = _mm_loadu_si128((const __m128i*)(utf8_bytes + i));
+        mask = _mm_movemask_epi8(_mm_or_si128(chunk, _mm_cmpeq_epi8(chunk, zero)));
+
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + ascii_prefix_scalar(utf8_bytes + i, utf8_len - i);
+}
+
+__attribute__((target("sse2")))
+static int32_t identifier_prefix_sse2(const uint8_t* utf8_bytes, int32_t utf8_len)
+{
+    __m128i chunk, lower, valid;
+    uint32_t mask;
+    int32_t i;
+
+    for (i = 0; i + 16 <= utf8_len; i += 16)
+    {
+        chunk = _mm_loadu_si128((const __m128i*)(utf8_bytes + i));
+
+        // Signed compares reject every non-ASCII byte; or-ing in 0x20 folds
+        // 'A'-'Z' onto 'a'-'z' without bringing any other byte into range.
+        lower = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+        valid = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+        valid = _mm_or_si128(valid, _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(chunk, _mm_set1_epi8('9' + 1))));
+        valid = _mm_or_si128(valid, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('_')));
+        valid = _mm_or_si128(valid, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('$')));
+        valid = _mm_or_si128(valid, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('/')));
+        mask = ~_mm_movemask_epi8(valid) & 0xFFFF;
+
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + identifier_prefix_scalar(utf8_bytes + i, utf8_len - i);
+}
+
+__attribute__((target("avx2")))
+static int32_t ascii_prefix_avx2(const uint8_t* utf8_bytes, int32_t utf8_len)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i chunk;
+    uint32_t mask;
+    int32_t i;
+
+    for (i = 0; i + 32 <= utf8_len; i += 32)
+    {
+        chunk = _mm256_loadu_si256((const __m256i*)(utf8_bytes + i));
+        mask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(chunk, _mm256_cmpeq_epi8(chunk, zero)));
+
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + ascii_prefix_sse2(utf8_bytes + i, utf8_len - i);
+}
+
+__attribute__((target("avx2")))
+static int32_t identifier_prefix_avx2(const uint8_t* utf8_bytes, int32_t utf8_len)
+{
+    __m256i chunk, lower, valid;
+    uint32_t mask;
+    int32_t i;
+
+    for (i = 0; i + 32 <= utf8_len; i += 32)
+    {
+        chunk = _mm256_loadu_si256((const __m256i*)(utf8_bytes + i));
+        lower = _mm256_or_si256(chunk, _mm256_set1_epi8(0x20));
+        valid = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+        valid = _mm256_or_si256(valid, _mm256_and_si256(_mm256_cmpgt_epi8(chunk, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), chunk)));
+        valid = _mm256_or_si256(valid, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('_')));
+        valid = _mm256_or_si256(valid, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('$')));
+        valid = _mm256_or_si256(valid, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('/')));
+        mask = ~(uint32_t)_mm256_movemask_epi8(valid);
+
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + identifier_prefix_sse2(utf8_bytes + i, utf8_len - i);
+}
+
+#endif
+
+static void select_utf8_scanners(void)
+{
+    uint8_t c;
+
+    for (c = 0; c < 128; c++)
+        identifier_byte[c] = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '$' || c == '/';
+
+    ascii_prefix = ascii_prefix_scalar;
+    identifier_prefix = identifier_prefix_scalar;
+
+#ifdef UTF8_SIMD_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        ascii_prefix = ascii_prefix_avx2;
+        identifier_prefix = identifier_prefix_avx2;
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        ascii_prefix = ascii_prefix_sse2;
+        identifier_prefix = identifier_prefix_sse2;
+    }
+#endif
+}
+
+int32_t utf8_ascii_prefix_length(const uint8_t* utf8_bytes, int32_t utf8_len)
+{
+    pthread_once(&dispatch_once, select_utf8_scanners);
+    return ascii_prefix(utf8_bytes, utf8_len);
+}
+
+int32_t utf8_identifier_prefix_length(const uint8_t* utf8_bytes, int32_t utf8_len)
+{
+    pthread_once(&dispatch_once, select_utf8_scanners);
+    return identifier_prefix(utf8_bytes, utf8_len);
+}
@@ -1,6 +1,9 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
 #include <locale.h>
 #include <wctype.h>
 #include <ctype.h>
+#include <string.h>
 #include "validity.h"
 #include "constantpool.h"
 #include "utf8.h"
@@ -150,16 +153,68 @@ char check_class_name_mathcing_with_file(java_class* jc, const char* class_file_
     return compare_filepath_utf8(cpi->Utf8.bytes, cpi->Utf8.length, (uint8_t*)class_file_path + begin, end - begin);
 }
 
+// Non-ASCII letters are classified with a locale object of their own
+// rather than the process locale, so prefetch workers can validate in
+// parallel and every class sees the same rules.
+static locale_t identifier_locale = (locale_t)0;
+static pthread_once_t identifier_locale_once = PTHREAD_ONCE_INIT;
+
+static void create_identifier_locale(void)
+{
+    identifier_locale = newlocale(LC_CTYPE_MASK, "pt_BR.UTF-8", (locale_t)0);
+
+    if (!identifier_locale)
+        identifier_locale = newlocale(LC_CTYPE_MASK, "C.UTF-8", (locale_t)0);
+
+    if (!identifier_locale)
+        identifier_locale = newlocale(LC_CTYPE_MASK, "C", (locale_t)0);
+}
+
+static uint8_t is_identifier_letter(uint32_t utf8_char)
+{
+    if (utf8_char < 0x80)
+        return isalpha((int)utf8_char) || utf8_char == '_' || utf8_char == '$';
+
+    pthread_once(&identifier_locale_once, create_identifier_locale);
+
+    return identifier_locale && iswalpha_l((wint_t)utf8_char, identifier_locale);
+}
+
 char java_identifier_is_valid(uint8_t* utf8_bytes, int32_t utf8_length, uint8_t id_class_identifier)
 {
     uint32_t utf8_char;
     uint8_t used_bytes;
     uint8_t first_character = 1;
     char is_valid = 1;
+    int32_t ascii_length;
+    uint8_t* slash;
 
     if (*utf8_bytes == '[')
         return read_field_descriptor(utf8_bytes, utf8_length, 1) == utf8_length;
 
+    // The leading run of ASCII letters, digits, '_', '$' and '/' only needs
+    // the positions of digits and slashes checked.
+    ascii_length = utf8_identifier_prefix_length(utf8_bytes, utf8_length);
+
+    if (ascii_length > 0)
+    {
+        if (isdigit(*utf8_bytes) || *utf8_bytes == '/')
+            return 0;
+
+        for (slash = memchr(utf8_bytes, '/', ascii_length); slash; slash = memchr(slash + 1, '/', utf8_bytes + ascii_length - slash - 1))
+        {
+            if (!id_class_identifier ||
+                (slash + 1 < utf8_bytes + ascii_length && (isdigit(slash[1]) || slash[1] == '/')))
+            {
+                return 0;
+            }
+        }
+
+        first_character = utf8_bytes[ascii_length - 1] == '/';
+        utf8_bytes += ascii_length;
+        utf8_length -= ascii_length;
+    }
+
     while (utf8_length > 0)
     {
         used_bytes = next_char_utf8(utf8_bytes, utf8_length, &utf8_char);
@@ -170,7 +225,7 @@ char java_identifier_is_valid(uint8_t* utf8_bytes, int32_t utf8_length, uint8_t
             break;
         }
 
-        if (isalpha(utf8_char) || utf8_char == '_' || utf8_char == '$' || (isdigit(utf8_char) && !first_character) || iswalpha(utf8_char) || (utf8_char == '/' && !first_character && id_class_identifier))
+        if (is_identifier_letter(utf8_char) || (utf8_char < 0x80 && isdigit((int)utf8_char) && !first_character) || (utf8_char == '/' && !first_character && id_class_identifier))
         {
             first_character = utf8_char == '/';
             utf8_length -= used_bytes;
@@ -278,12 +333,10 @@ char check_idx_method_name_and_type(java_class* jc, uint16_t name_and_type_index
     return 1;
 }
 
-
 char check_constant_pool_is_valid(java_class* jc)
 {
     uint16_t i;
     char success = 1;
-    char* prev_locale = setlocale(LC_CTYPE, "pt_BR.UTF-8");
 
     for (i = 0; success && i < jc->constant_pool_count - 1; i++)
     {
@@ -357,10 +410,8 @@ char check_constant_pool_is_valid(java_class* jc)
                 break;
         }
 
-        jc->validity_entries_checked = i + 1;
+        jc->reader->validity_entries_checked = i + 1;
     }
 
-    setlocale(LC_CTYPE, prev_locale);
-
     return success;
 }
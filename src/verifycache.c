@@ -0,0 +1,349 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "verifycache.h"
+#include "mappedfile.h"
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#define VERIFICATION_CACHE_MAGIC 0x4643564AUL
+#define VERIFICATION_CACHE_VERSION 2
+#define VERIFICATION_CACHE_HEADER_SIZE 12
+#define VERIFICATION_CACHE_ENTRY_SIZE 36
+#define VERIFICATION_CACHE_INITIAL_SIZE 256
+
+// Layout, all values little-endian:
+//   header:  magic, version, entry count
+//   entries: class file length followed by the eight SHA-256 words
+// Only classes that passed every check are recorded. The file is always
+// replaced as a whole, so concurrent VMs see either the old or the new set.
+// Class files are untrusted input and a cached digest lets one skip every
+// structural check, so the digest has to be collision resistant. The cache
+// file itself is trusted like the class path.
+
+struct verification_cache
+{
+    char* path;
+    class_digest* table;
+    uint32_t table_size;
+    uint32_t count;
+    uint32_t added;
+    pthread_mutex_t lock;
+};
+
+static uint32_t read_u4_le(const uint8_t* bytes)
+{
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static void write_u4_le(uint8_t* bytes, uint32_t value)
+{
+    bytes[0] = (uint8_t)value;
+    bytes[1] = (uint8_t)(value >> 8);
+    bytes[2] = (uint8_t)(value >> 16);
+    bytes[3] = (uint8_t)(value >> 24);
+}
+
+static const uint32_t sha256_constants[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+#define SHA256_ROTATE(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(uint32_t* state, const uint8_t* block)
+{
+    uint32_t schedule[64];
+    uint32_t a, b, c, d, e, f, g, h, t1, t2;
+    uint32_t index;
+
+    for (index = 0; index < 16; index++)
+    {
+        schedule[index] = ((uint32_t)block[index * 4] << 24) | ((uint32_t)block[index * 4 + 1] << 16) |
+                          ((uint32_t)block[index * 4 + 2] << 8) | block[index * 4 + 3];
+    }
+
+    for (; index < 64; index++)
+    {
+        t1 = schedule[index - 2];
+        t2 = schedule[index - 15];
+        schedule[index] = (SHA256_ROTATE(t1, 17) ^ SHA256_ROTATE(t1, 19) ^ (t1 >> 10)) + schedule[index - 7] +
+                          (SHA256_ROTATE(t2, 7) ^ SHA256_ROTATE(t2, 18) ^ (t2 >> 3)) + schedule[index - 16];
+    }
+
+    a = state[0]; b = state[1]; c = state[2]; d = state[3];
+    e = state[4]; f = state[5]; g = state[6]; h = state[7];
+
+    for (index = 0; index < 64; index++)
+    {
+        t1 = h + (SHA256_ROTATE(e, 6) ^ SHA256_ROTATE(e, 11) ^ SHA256_ROTATE(e, 25)) + ((e & f) ^ (~e & g)) +
+             sha256_constants[index] + schedule[index];
+        t2 = (SHA256_ROTATE(a, 2) ^ SHA256_ROTATE(a, 13) ^ SHA256_ROTATE(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void compute_class_digest(const uint8_t* image, uint32_t length, class_digest* digest)
+{
+    static const uint32_t initial_state[8] = {
+        0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+    };
+    uint8_t tail[128];
+    uint64_t bits = (uint64_t)length * 8;
+    uint32_t offset, remaining, tail_length, index;
+
+    memcpy(digest->words, initial_state, sizeof(initial_state));
+    digest->length = length;
+
+    for (offset = 0; length - offset >= 64; offset += 64)
+        sha256_block(digest->words, image + offset);
+
+    // The last partial block, the 0x80 terminator and the bit length take
+    // one or two more blocks.
+    remaining = length - offset;
+    tail_length = remaining < 56 ? 64 : 128;
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, image + offset, remaining);
+    tail[remaining] = 0x80;
+
+    for (index = 0; index < 8; index++)
+        tail[tail_length - 1 - index] = (uint8_t)(bits >> (index * 8));
+
+    for (offset = 0; offset < tail_length; offset += 64)
+        sha256_block(digest->words, tail + offset);
+}
+
+static uint8_t digests_are_equal(const class_digest* a, const class_digest* b)
+{
+    return a->length == b->length && !memcmp(a->words, b->words, sizeof(a->words));
+}
+
+static class_digest* find_digest_slot(verification_cache* cache, const class_digest* digest)
+{
+    uint32_t slot = digest->words[0] & (cache->table_size - 1);
+
+    while (cache->table[slot].length && !digests_are_equal(cache->table + slot, digest))
+        slot = (slot + 1) & (cache->table_size - 1);
+
+    return cache->table + slot;
+}
+
+static uint8_t grow_digest_table(verification_cache* cache)
+{
+    uint32_t new_size = cache->table_size * 2;
+    class_digest* old_table = cache->table;
+    uint32_t old_size = cache->table_size;
+    uint32_t index;
+
+    cache->table = (class_digest*)calloc(new_size, sizeof(class_digest));
+
+    if (!cache->table)
+    {
+        cache->table = old_table;
+        return 0;
+    }
+
+    cache->table_size = new_size;
+
+    for (index = 0; index < old_size; index++)
+    {
+        if (old_table[index].length)
+            *find_digest_slot(cache, old_table + index) = old_table[index];
+    }
+
+    free(old_table);
+
+    return 1;
+}
+
+static uint8_t insert_digest(verification_cache* cache, const class_digest* digest)
+{
+    class_digest* slot;
+
+    // A zero length marks an empty slot; no class file is that short.
+    if (digest->length == 0)
+        return 0;
+
+    if ((cache->count + 1) * 4 > cache->table_size * 3 && !grow_digest_table(cache))
+        return 0;
+
+    slot = find_digest_slot(cache, digest);
+
+    if (slot->length)
+        return 0;
+
+    *slot = *digest;
+    cache->count++;
+
+    return 1;
+}
+
+static void load_cache_file(verification_cache* cache)
+{
+    const uint8_t* image;
+    const uint8_t* entry;
+    uint32_t length, count, index, word;
+    uint8_t mapped;
+    class_digest digest;
+
+    if (!map_file(cache->path, &image, &length, &mapped))
+        return;
+
+    if (length >= VERIFICATION_CACHE_HEADER_SIZE &&
+        read_u4_le(image) == VERIFICATION_CACHE_MAGIC &&
+        read_u4_le(image + 4) == VERIFICATION_CACHE_VERSION)
+    {
+        count = read_u4_le(image + 8);
+
+        if (count > (length - VERIFICATION_CACHE_HEADER_SIZE) / VERIFICATION_CACHE_ENTRY_SIZE)
+            count = (length - VERIFICATION_CACHE_HEADER_SIZE) / VERIFICATION_CACHE_ENTRY_SIZE;
+
+        for (index = 0, entry = image + VERIFICATION_CACHE_HEADER_SIZE; index < count; index++, entry += VERIFICATION_CACHE_ENTRY_SIZE)
+        {
+            digest.length = read_u4_le(entry);
+
+            for (word = 0; word < 8; word++)
+                digest.words[word] = read_u4_le(entry + 4 + word * 4);
+
+            insert_digest(cache, &digest);
+        }
+    }
+
+    unmap_file(image, length, mapped);
+}
+
+verification_cache* open_verification_cache(const char* path)
+{
+    verification_cache* cache = (verification_cache*)malloc(sizeof(verification_cache));
+
+    if (!cache)
+        return NULL;
+
+    cache->path = (char*)malloc(strlen(path) + 1);
+    cache->table_size = VERIFICATION_CACHE_INITIAL_SIZE;
+    cache->table = (class_digest*)calloc(cache->table_size, sizeof(class_digest));
+    cache->count = 0;
+    cache->added = 0;
+
+    if (!cache->path || !cache->table)
+    {
+        free(cache->path);
+        free(cache->table);
+        free(cache);
+        return NULL;
+    }
+
+    strcpy(cache->path, path);
+    pthread_mutex_init(&cache->lock, NULL);
+    load_cache_file(cache);
+
+    return cache;
+}
+
+static uint8_t write_cache_file(verification_cache* cache)
+{
+    char temporary_path[1024];
+    uint8_t buffer[VERIFICATION_CACHE_ENTRY_SIZE];
+    uint8_t success = 1;
+    uint32_t index, word;
+    FILE* file;
+
+    // Each process writes its own temporary file, and the rename replaces
+    // the cache atomically. Entries another VM stored after this one loaded
+    // the file were merged back by the caller.
+    snprintf(temporary_path, sizeof(temporary_path), "%s.%ld.tmp", cache->path, (long)getpid());
+    file = fopen(temporary_path, "wb");
+
+    if (!file)
+        return 0;
+
+    write_u4_le(buffer, VERIFICATION_CACHE_MAGIC);
+    write_u4_le(buffer + 4, VERIFICATION_CACHE_VERSION);
+    write_u4_le(buffer + 8, cache->count);
+    success = fwrite(buffer, 1, VERIFICATION_CACHE_HEADER_SIZE, file) == VERIFICATION_CACHE_HEADER_SIZE;
+
+    for (index = 0; success && index < cache->table_size; index++)
+    {
+        class_digest* digest = cache->table + index;
+
+        if (!digest->length)
+            continue;
+
+        write_u4_le(buffer, digest->length);
+
+        for (word = 0; word < 8; word++)
+            write_u4_le(buffer + 4 + word * 4, digest->words[word]);
+
+        success = fwrite(buffer, 1, VERIFICATION_CACHE_ENTRY_SIZE, file) == VERIFICATION_CACHE_ENTRY_SIZE;
+    }
+
+    success = fclose(file) == 0 && success;
+
+    if (success)
+    {
+#ifdef _WIN32
+        remove(cache->path);
+#endif
+        success = rename(temporary_path, cache->path) == 0;
+    }
+
+    if (!success)
+        remove(temporary_path);
+
+    return success;
+}
+
+uint8_t close_verification_cache(verification_cache* cache)
+{
+    uint8_t success = 1;
+
+    if (cache->added)
+    {
+        load_cache_file(cache);
+        success = write_cache_file(cache);
+    }
+
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->table);
+    free(cache->path);
+    free(cache);
+
+    return success;
+}
+
+uint8_t class_digest_is_verified(verification_cache* cache, const class_digest* digest)
+{
+    uint8_t found;
+
+    pthread_mutex_lock(&cache->lock);
+    found = find_digest_slot(cache, digest)->length != 0;
+    pthread_mutex_unlock(&cache->lock);
+
+    return found;
+}
+
+void add_verified_class_digest(verification_cache* cache, const class_digest* digest)
+{
+    pthread_mutex_lock(&cache->lock);
+
+    if (insert_digest(cache, digest))
+        cache->added++;
+
+    pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,21 @@
+#ifndef VERIFYCACHE_H
+#define VERIFYCACHE_H
+
+#include <stdint.h>
+
+// The SHA-256 of a class file, kept as its eight state words.
+typedef struct class_digest
+{
+    uint32_t length;
+    uint32_t words[8];
+} class_digest;
+
+typedef struct verification_cache verification_cache;
+
+void compute_class_digest(const uint8_t*, uint32_t, class_digest*);
+verification_cache* open_verification_cache(const char*);
+uint8_t close_verification_cache(verification_cache*);
+uint8_t class_digest_is_verified(verification_cache*, const class_digest*);
+void add_verified_class_digest(verification_cache*, const class_digest*);
+
+#endif
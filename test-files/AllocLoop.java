@@ -0,0 +1,22 @@
+class AllocLoop {
+	public static void main(String argv[]) {
+		// About 100 MB is allocated in total, more than the default heap and
+		// far more than a small heap such as -Xmx1m, while only the last block
+		// stays reachable.
+		int[] keep = null;
+		int odd = 0;
+
+		for (int i = 0; i < 100000; i++) {
+			int[] block = new int[256];
+			block[0] = i;
+
+			if (keep != null)
+				odd += keep[0] & 1;
+
+			keep = block;
+		}
+
+		System.out.println(odd);
+		System.out.println(keep[0]);
+	}
+}
@@ -0,0 +1,24 @@
+// BooleanMask.class is assembled by hand, because javac only ever stores 0
+// or 1 into a boolean field. Each assignment below is compiled as a push of
+// the value in its comment followed by putfield. putfield keeps only the
+// low bit of a boolean, so this prints false, true, true, false and then 5,
+// the neighbouring byte left untouched.
+class BooleanMask {
+	boolean z;
+	byte b;
+
+	public static void main(String argv[]) {
+		BooleanMask o = new BooleanMask();
+
+		o.b = 5;
+		o.z = false; // stored as 2
+		System.out.println(o.z);
+		o.z = true; // stored as 3
+		System.out.println(o.z);
+		o.z = true; // stored as -1
+		System.out.println(o.z);
+		o.z = false; // stored as 4
+		System.out.println(o.z);
+		System.out.println(o.b);
+	}
+}
@@ -0,0 +1,38 @@
+class FieldLayoutBase {
+	byte pb;
+	long pl;
+	int pi;
+}
+
+class FieldLayoutChild extends FieldLayoutBase {
+	boolean z;
+	short s;
+	char c;
+	byte b;
+	long l;
+}
+
+class FieldLayout {
+	public static void main(String argv[]) {
+		FieldLayoutChild o = new FieldLayoutChild();
+		int v = 200;
+
+		o.pb = -1;
+		o.pl = 1311768467463790320L;
+		o.pi = 2147483647;
+		o.z = false;
+		o.s = (short) 40000;
+		o.c = (char) -1;
+		o.b = (byte) v;
+		o.l = -9000000000000000000L;
+
+		System.out.println(o.pb);
+		System.out.println(o.pl);
+		System.out.println(o.pi);
+		System.out.println(o.z);
+		System.out.println(o.s);
+		System.out.println((int) o.c);
+		System.out.println(o.b);
+		System.out.println(o.l);
+	}
+}
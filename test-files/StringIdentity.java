@@ -0,0 +1,28 @@
+class StringIdentityOther {
+	static String greeting() {
+		return "hello";
+	}
+}
+
+class StringIdentity {
+	static String greeting() {
+		return "hello";
+	}
+
+	public static void main(String argv[]) {
+		String a = "hello";
+		String first = greeting();
+		int same = 0;
+
+		for (int i = 0; i < 1000; i++) {
+			if (greeting() == first)
+				same++;
+		}
+
+		System.out.println(a == "hello");
+		System.out.println(a == first);
+		System.out.println(a == StringIdentityOther.greeting());
+		System.out.println(a == "world");
+		System.out.println(same);
+	}
+}